@@ -0,0 +1,25 @@
+// Copyright Project Borealis
+
+#include "Camera/PBCameraRollModifier.h"
+
+#include "Camera/CameraTypes.h"
+#include "GameFramework/Pawn.h"
+
+#include "Character/PBPlayerMovement.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(PBCameraRollModifier)
+
+bool UPBCameraRollModifier::ModifyCamera(float DeltaTime, FMinimalViewInfo& InOutPOV)
+{
+	Super::ModifyCamera(DeltaTime, InOutPOV);
+
+	const APawn* ViewPawn = Cast<APawn>(GetViewTarget());
+	const UPBPlayerMovement* Movement = ViewPawn ? Cast<UPBPlayerMovement>(ViewPawn->GetMovementComponent()) : nullptr;
+	if (Movement)
+	{
+		InOutPOV.Rotation.Roll += Movement->GetCameraRoll() * Alpha;
+	}
+
+	// Let the modifiers after us run
+	return false;
+}
@@ -0,0 +1,36 @@
+// Copyright Project Borealis
+
+#include "Camera/PBLateLatchCameraModifier.h"
+
+#include "Camera/CameraTypes.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(PBLateLatchCameraModifier)
+
+bool UPBLateLatchCameraModifier::ModifyCamera(float DeltaTime, FMinimalViewInfo& InOutPOV)
+{
+	Super::ModifyCamera(DeltaTime, InOutPOV);
+
+	// Only when we're looking through our own pawn's eyes, spectated views follow their own control rotation
+	const APlayerController* PlayerController = CameraOwner ? CameraOwner->GetOwningPlayerController() : nullptr;
+	if (!PlayerController || !PlayerController->GetPawn() || GetViewTarget() != PlayerController->GetPawn() || PlayerController->IsLookInputIgnored())
+	{
+		return false;
+	}
+
+	// UE-COPY: APlayerController::UpdateRotation, without the view target's rotation update
+	const FRotator& PendingLook = PlayerController->RotationInput;
+	if (PendingLook.IsNearlyZero())
+	{
+		return false;
+	}
+	FRotator ViewRotation = InOutPOV.Rotation;
+	ViewRotation += PendingLook * Alpha;
+	CameraOwner->LimitViewPitch(ViewRotation, CameraOwner->ViewPitchMin, CameraOwner->ViewPitchMax);
+	InOutPOV.Rotation = ViewRotation;
+
+	// Let the modifiers after us run
+	return false;
+}
@@ -0,0 +1,97 @@
+// Copyright Project Borealis
+
+#include "Character/PBLagCompensationHistory.h"
+
+void FPBLagCompensationHistory::Init(int32 Capacity)
+{
+	Capacity = FMath::Max(Capacity, 1);
+	Times.SetNumZeroed(Capacity);
+	Locations.SetNumZeroed(Capacity);
+	HalfHeights.SetNumZeroed(Capacity);
+	CrouchAlphas.SetNumZeroed(Capacity);
+	Reset();
+}
+
+void FPBLagCompensationHistory::Reset()
+{
+	Head = 0;
+	Count = 0;
+}
+
+void FPBLagCompensationHistory::Record(double Time, const FVector& Location, float HalfHeight, float CrouchAlpha)
+{
+	const int32 Capacity = Times.Num();
+	if (Capacity == 0)
+	{
+		return;
+	}
+
+	int32 Slot;
+	if (Count > 0 && Times[ToSlot(Count - 1)] >= Time)
+	{
+		// Several moves in one server frame, keep where the last one ended
+		Slot = ToSlot(Count - 1);
+	}
+	else if (Count < Capacity)
+	{
+		Slot = ToSlot(Count);
+		Count++;
+	}
+	else
+	{
+		// Full, overwrite the oldest
+		Slot = Head;
+		Head = (Head + 1) % Capacity;
+	}
+
+	Times[Slot] = Time;
+	Locations[Slot] = Location;
+	HalfHeights[Slot] = HalfHeight;
+	CrouchAlphas[Slot] = CrouchAlpha;
+}
+
+bool FPBLagCompensationHistory::Rewind(double Time, FPBLagCompensationSample& OutSample) const
+{
+	if (Count == 0)
+	{
+		return false;
+	}
+
+	const int32 Newest = ToSlot(Count - 1);
+	if (Time >= Times[Newest])
+	{
+		OutSample = {Times[Newest], Locations[Newest], HalfHeights[Newest], CrouchAlphas[Newest]};
+		return true;
+	}
+	const int32 Oldest = ToSlot(0);
+	if (Time <= Times[Oldest])
+	{
+		OutSample = {Times[Oldest], Locations[Oldest], HalfHeights[Oldest], CrouchAlphas[Oldest]};
+		return Time == Times[Oldest];
+	}
+
+	// First sample newer than Time, the one before it is older
+	int32 Low = 1;
+	int32 High = Count - 1;
+	while (Low < High)
+	{
+		const int32 Mid = (Low + High) / 2;
+		if (Times[ToSlot(Mid)] > Time)
+		{
+			High = Mid;
+		}
+		else
+		{
+			Low = Mid + 1;
+		}
+	}
+
+	const int32 After = ToSlot(Low);
+	const int32 Before = ToSlot(Low - 1);
+	const float Alpha = static_cast<float>((Time - Times[Before]) / (Times[After] - Times[Before]));
+	OutSample.Time = Time;
+	OutSample.Location = FMath::Lerp(Locations[Before], Locations[After], Alpha);
+	OutSample.HalfHeight = FMath::Lerp(HalfHeights[Before], HalfHeights[After], Alpha);
+	OutSample.CrouchAlpha = FMath::Lerp(CrouchAlphas[Before], CrouchAlphas[After], Alpha);
+	return true;
+}
@@ -0,0 +1,271 @@
+// Copyright Project Borealis
+
+#include "Character/PBMovementValidationSubsystem.h"
+
+#include "Async/ParallelFor.h"
+#include "Tasks/Task.h"
+
+#include "Character/PBPlayerMovement.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(PBMovementValidationSubsystem)
+
+DECLARE_CYCLE_STAT(TEXT("Char Validation Batch"), STAT_CharValidationBatch, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Validation Samples"), STAT_CharValidationSamples, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Validation Violations"), STAT_CharValidationViolations, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Validation Flags"), STAT_CharValidationFlags, STATGROUP_Character);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Char Validation Cost Per Player (us)"), STAT_CharValidationCostPerPlayer, STATGROUP_Character);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Char Validation Cost Max Player (us)"), STAT_CharValidationCostMaxPlayer, STATGROUP_Character);
+
+void UPBMovementValidationSubsystem::Deinitialize()
+{
+	// The batch works on our players, it can't outlive us
+	BatchTask.Wait();
+	Players.Empty();
+	PlayerIndices.Empty();
+	PendingSamples.Empty();
+	Super::Deinitialize();
+}
+
+bool UPBMovementValidationSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+TStatId UPBMovementValidationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPBMovementValidationSubsystem, STATGROUP_Tickables);
+}
+
+void UPBMovementValidationSubsystem::QueueSample(UPBPlayerMovement* Movement, const FPBMovementValidationSample& Sample)
+{
+	check(IsInGameThread());
+	PendingSamples.FindOrAdd(Movement).Add(Sample);
+}
+
+float UPBMovementValidationSubsystem::GetValidationCost(const UPBPlayerMovement* Movement) const
+{
+	const int32* Index = PlayerIndices.Find(Movement);
+	return Index ? Players[*Index].LastCostMicroseconds : 0.0f;
+}
+
+void UPBMovementValidationSubsystem::Tick(float DeltaTime)
+{
+	// Still validating, keep queueing rather than wait on it
+	if (!BatchTask.IsCompleted())
+	{
+		return;
+	}
+
+	if (bHasBatchResults)
+	{
+		ApplyResults();
+		bHasBatchResults = false;
+	}
+
+	if (PendingSamples.IsEmpty())
+	{
+		return;
+	}
+
+	uint32 NumSamples = 0;
+	for (TPair<TObjectKey<UPBPlayerMovement>, TArray<FPBMovementValidationSample>>& Pending : PendingSamples)
+	{
+		int32* Index = PlayerIndices.Find(Pending.Key);
+		if (!Index)
+		{
+			UPBPlayerMovement* Movement = Pending.Key.ResolveObjectPtr();
+			if (!Movement)
+			{
+				continue;
+			}
+			FPlayer& NewPlayer = Players.AddDefaulted_GetRef();
+			NewPlayer.Movement = Movement;
+			Index = &PlayerIndices.Add(Pending.Key, Players.Num() - 1);
+		}
+		NumSamples += Pending.Value.Num();
+		Players[*Index].Samples = MoveTemp(Pending.Value);
+	}
+	PendingSamples.Reset();
+	INC_DWORD_STAT_BY(STAT_CharValidationSamples, NumSamples);
+
+	BatchTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this]()
+	{
+		SCOPE_CYCLE_COUNTER(STAT_CharValidationBatch);
+		ParallelFor(Players.Num(), [this](int32 Index)
+		{
+			ValidatePlayer(Players[Index]);
+		});
+	});
+	bHasBatchResults = true;
+}
+
+void UPBMovementValidationSubsystem::ApplyResults()
+{
+	bool bRemovedPlayers = false;
+	float TotalCost = 0.0f;
+	float MaxCost = 0.0f;
+	int32 NumValidated = 0;
+	for (int32 Index = Players.Num() - 1; Index >= 0; Index--)
+	{
+		FPlayer& Player = Players[Index];
+		UPBPlayerMovement* Movement = Player.Movement.Get();
+		if (!Movement)
+		{
+			Players.RemoveAtSwap(Index);
+			bRemovedPlayers = true;
+			continue;
+		}
+
+		if (!Player.Samples.IsEmpty())
+		{
+			NumValidated++;
+			TotalCost += Player.CostMicroseconds;
+			MaxCost = FMath::Max(MaxCost, Player.CostMicroseconds);
+			Player.LastCostMicroseconds = Player.CostMicroseconds;
+		}
+		INC_DWORD_STAT_BY(STAT_CharValidationViolations, Player.Violations);
+
+		const EPBMovementViolation FlaggedViolation = Player.FlaggedViolation;
+		const float FlaggedSuspicion = Player.FlaggedSuspicion;
+		Player.Samples.Reset();
+		Player.FlaggedViolation = EPBMovementViolation::None;
+		Player.FlaggedSuspicion = 0.0f;
+		Player.Violations = 0;
+		Player.CostMicroseconds = 0.0f;
+
+		if (FlaggedViolation != EPBMovementViolation::None)
+		{
+			INC_DWORD_STAT(STAT_CharValidationFlags);
+			OnSuspiciousMovement.Broadcast(Movement, FlaggedViolation, FlaggedSuspicion);
+		}
+	}
+
+	if (bRemovedPlayers)
+	{
+		PlayerIndices.Reset();
+		for (int32 Index = 0; Index < Players.Num(); Index++)
+		{
+			PlayerIndices.Add(Players[Index].Movement.Get(), Index);
+		}
+	}
+
+	if (NumValidated > 0)
+	{
+		SET_FLOAT_STAT(STAT_CharValidationCostPerPlayer, TotalCost / NumValidated);
+		SET_FLOAT_STAT(STAT_CharValidationCostMaxPlayer, MaxCost);
+	}
+}
+
+void UPBMovementValidationSubsystem::ValidatePlayer(FPlayer& Player)
+{
+	if (Player.Samples.IsEmpty())
+	{
+		return;
+	}
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	for (const FPBMovementValidationSample& Sample : Player.Samples)
+	{
+		const FPBMovementValidationLimits& Limits = Sample.Limits;
+		Player.Suspicion = FMath::Max(Player.Suspicion - Limits.SuspicionDecayRate * Sample.DeltaTime, 0.0f);
+
+		const EPBMovementViolation Violation = ValidateSample(Player, Sample);
+		if (Violation == EPBMovementViolation::None)
+		{
+			continue;
+		}
+
+		Player.Violations++;
+		Player.Suspicion += 1.0f;
+		// First flag of the batch is the one reported, start counting again after it
+		if (Player.Suspicion >= Limits.SuspicionThreshold && Player.FlaggedViolation == EPBMovementViolation::None)
+		{
+			Player.FlaggedViolation = Violation;
+			Player.FlaggedSuspicion = Player.Suspicion;
+			Player.Suspicion = 0.0f;
+		}
+	}
+	Player.CostMicroseconds = static_cast<float>(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) * 1000.0);
+}
+
+EPBMovementViolation UPBMovementValidationSubsystem::ValidateSample(FPlayer& Player, const FPBMovementValidationSample& Sample)
+{
+	// Time between the client's moves, not this move's DeltaTime, as moves we don't check fall in between.
+	// Going back means the client reset its timestamps.
+	const float ElapsedTime = Sample.ClientTimeStamp - Player.LastTimeStamp;
+	if (!Player.bHasLastLocation || Sample.bDiscontinuous || ElapsedTime <= UE_SMALL_NUMBER)
+	{
+		// We don't know how they got here, only start checking from here on
+		Player.LastLocation = Sample.ClientLocation;
+		Player.LastTimeStamp = Sample.ClientTimeStamp;
+		Player.bHasLastLocation = true;
+		Player.bHasLastVelocity = false;
+		return EPBMovementViolation::None;
+	}
+
+	// Bounds are on distance travelled, so PositionTolerance is a fixed slack rather than a speed that grows as moves get shorter
+	const FPBMovementValidationLimits& Limits = Sample.Limits;
+	const FVector Displacement = Sample.ClientLocation - Player.LastLocation;
+	const FVector ClientVelocity = Displacement / ElapsedTime;
+	const FVector LastVelocity = Player.LastVelocity;
+	const bool bHasLastVelocity = Player.bHasLastVelocity;
+	Player.LastLocation = Sample.ClientLocation;
+	Player.LastTimeStamp = Sample.ClientTimeStamp;
+	Player.LastVelocity = ClientVelocity;
+	Player.bHasLastVelocity = true;
+
+	// Nothing can go faster than AxisSpeedLimit on an axis
+	const float MaxAxisDistance = Limits.AxisSpeedLimit * Limits.SpeedTolerance * ElapsedTime + Limits.PositionTolerance;
+	if (Displacement.GetAbsMax() > MaxAxisDistance)
+	{
+		return EPBMovementViolation::AxisSpeed;
+	}
+
+	// Speed bounds below are on change in speed, so they need a speed to start from
+	if (!bHasLastVelocity)
+	{
+		return EPBMovementViolation::None;
+	}
+
+	const float Distance = Displacement.Size2D();
+	const float LastSpeed = LastVelocity.Size2D();
+	const float JumpSpeedAllowance = Sample.bJumping ? Limits.JumpSpeedAllowance : 0.0f;
+	float MaxSpeed;
+	EPBMovementViolation SpeedViolation;
+	if (Sample.bFalling)
+	{
+		// Each air acceleration can add at most AirSpeedCap at right angles to our velocity, see UPBPlayerMovement::Accelerate
+		const float Substeps = Limits.MaxSimulationTimeStep > 0.0f ? FMath::CeilToFloat(ElapsedTime / Limits.MaxSimulationTimeStep) : 1.0f;
+		MaxSpeed = FMath::Sqrt(FMath::Square(LastSpeed) + Substeps * FMath::Square(Limits.AirSpeedCap)) + JumpSpeedAllowance;
+		SpeedViolation = EPBMovementViolation::AirAcceleration;
+	}
+	else if (Sample.bCrouchSliding)
+	{
+		// Slide boost, see UPBPlayerMovement::StartCrouchSlide
+		MaxSpeed = FMath::Max(Limits.MaxSpeed, FMath::Max(Limits.MinCrouchSlideBoost, LastSpeed) * Limits.CrouchSlideBoostMultiplier);
+		SpeedViolation = EPBMovementViolation::SlideBoost;
+	}
+	else
+	{
+		// Landing keeps air speed until friction takes it, so we can be faster than max speed but never speed up past it
+		MaxSpeed = FMath::Max(Limits.MaxSpeed, LastSpeed) + JumpSpeedAllowance;
+		SpeedViolation = EPBMovementViolation::GroundSpeed;
+	}
+	if (Distance > MaxSpeed * Limits.SpeedTolerance * ElapsedTime + Limits.PositionTolerance)
+	{
+		return SpeedViolation;
+	}
+
+	// Only a jump or the ground under us makes us rise
+	float MaxRise = FMath::Max(Limits.JumpZVelocity, LastVelocity.Z) * ElapsedTime + Limits.MaxStepHeight;
+	if (!Sample.bFalling)
+	{
+		MaxRise += Distance * Limits.MaxWalkableRise;
+	}
+	if (Displacement.Z > MaxRise * Limits.SpeedTolerance + Limits.PositionTolerance)
+	{
+		return EPBMovementViolation::JumpVelocity;
+	}
+
+	return EPBMovementViolation::None;
+}
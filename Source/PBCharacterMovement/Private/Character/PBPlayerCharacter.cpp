@@ -7,8 +7,13 @@
 #include "Components/CapsuleComponent.h"
 #include "HAL/IConsoleManager.h"
 #include "Engine/World.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/PlayerController.h"
 #include "Net/UnrealNetwork.h"
 
+#include "Camera/PBCameraRollModifier.h"
+#include "Camera/PBLateLatchCameraModifier.h"
+#include "Character/PBMovementSnapshot.h"
 #include "Character/PBPlayerMovement.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(PBPlayerCharacter)
@@ -85,6 +90,9 @@ APBPlayerCharacter::APBPlayerCharacter(const FObjectInitializer& ObjectInitializ
 	MinLandBounceSpeed = 329.565f;
 
 	CapDamageMomentumZ = 476.25f;
+
+	CameraRollModifierClass = UPBCameraRollModifier::StaticClass();
+	LateLatchModifierClass = UPBLateLatchCameraModifier::StaticClass();
 }
 
 void APBPlayerCharacter::BeginPlay()
@@ -93,12 +101,41 @@ void APBPlayerCharacter::BeginPlay()
 	Super::BeginPlay();
 	// Max jump time to get to the top of the arc
 	MaxJumpTime = -4.0f * GetCharacterMovement()->JumpZVelocity / (3.0f * GetCharacterMovement()->GetGravityZ());
+	if (bUseAdaptiveNetUpdateFrequency && HasAuthority())
+	{
+		ApplyNetUpdateTier(NetUpdateTier);
+	}
+}
+
+void APBPlayerCharacter::PawnClientRestart()
+{
+	Super::PawnClientRestart();
+
+	// Roll is cosmetic, so it goes on the camera rather than into the control rotation we send the server
+	const APlayerController* PlayerController = Cast<APlayerController>(GetController());
+	if (!PlayerController || !PlayerController->PlayerCameraManager)
+	{
+		return;
+	}
+	if (CameraRollModifierClass && !PlayerController->PlayerCameraManager->FindCameraModifierByClass(CameraRollModifierClass))
+	{
+		PlayerController->PlayerCameraManager->AddNewCameraModifier(CameraRollModifierClass);
+	}
+	if (bLateLatchViewRotation && LateLatchModifierClass && !PlayerController->PlayerCameraManager->FindCameraModifierByClass(LateLatchModifierClass))
+	{
+		PlayerController->PlayerCameraManager->AddNewCameraModifier(LateLatchModifierClass);
+	}
 }
 
 void APBPlayerCharacter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	if (bUseAdaptiveNetUpdateFrequency && HasAuthority() && GetNetMode() != NM_Standalone)
+	{
+		UpdateNetUpdateTier(DeltaTime);
+	}
+
 	if (bDeferJumpStop)
 	{
 		bDeferJumpStop = false;
@@ -106,13 +143,218 @@ void APBPlayerCharacter::Tick(float DeltaTime)
 	}
 }
 
+void APBPlayerCharacter::UpdateNetUpdateTier(float DeltaTime)
+{
+	const UCharacterMovementComponent* Movement = GetCharacterMovement();
+	const FVector Acceleration = Movement->GetCurrentAcceleration();
+	const bool bAccelerationChanged = (Acceleration - LastNetUpdateAcceleration).SizeSquared() > FMath::Square(NetUpdateAccelerationChange);
+	LastNetUpdateAcceleration = Acceleration;
+
+	EPBNetUpdateTier DesiredTier = EPBNetUpdateTier::Moving;
+	if (!Movement->IsMovingOnGround() || Movement->Velocity.SizeSquared() > FMath::Square(FastNetUpdateSpeed))
+	{
+		DesiredTier = EPBNetUpdateTier::Fast;
+	}
+	else if (Movement->Velocity.IsNearlyZero() && Acceleration.IsNearlyZero() && !bAccelerationChanged)
+	{
+		DesiredTier = EPBNetUpdateTier::Idle;
+	}
+
+	if (DesiredTier >= NetUpdateTier)
+	{
+		// Go up right away, changes in movement are what proxies need to see
+		NetUpdateTierLowerTime = 0.0f;
+		if (DesiredTier != NetUpdateTier)
+		{
+			ApplyNetUpdateTier(DesiredTier);
+			ForceNetUpdate();
+		}
+		return;
+	}
+
+	// Only come down once we've been slower for a while, so we don't flap between tiers
+	NetUpdateTierLowerTime += DeltaTime;
+	if (NetUpdateTierLowerTime >= NetUpdateTierHoldTime)
+	{
+		NetUpdateTierLowerTime = 0.0f;
+		ApplyNetUpdateTier(DesiredTier);
+	}
+}
+
+void APBPlayerCharacter::ApplyNetUpdateTier(EPBNetUpdateTier Tier)
+{
+	NetUpdateTier = Tier;
+	switch (Tier)
+	{
+		case EPBNetUpdateTier::Idle:
+			SetNetUpdateFrequency(IdleNetUpdateFrequency);
+			NetPriority = IdleNetPriority;
+			break;
+		case EPBNetUpdateTier::Moving:
+			SetNetUpdateFrequency(MovingNetUpdateFrequency);
+			NetPriority = MovingNetPriority;
+			break;
+		case EPBNetUpdateTier::Fast:
+			SetNetUpdateFrequency(FastNetUpdateFrequency);
+			NetPriority = FastNetPriority;
+			break;
+	}
+}
+
 void APBPlayerCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	// everyone except local owner: flag change is locally instigated
+	// everyone except local owner: flag change is locally instigated, and the owner sends it with its saved moves
 	DOREPLIFETIME_CONDITION(APBPlayerCharacter, bIsSprinting, COND_SkipOwner);
 	DOREPLIFETIME_CONDITION(APBPlayerCharacter, bWantsToWalk, COND_SkipOwner);
+	// only simulated proxies need the crouch transition, everyone else simulates it
+	DOREPLIFETIME_CONDITION(APBPlayerCharacter, ReplicatedCrouchAlpha, COND_SimulatedOnly);
+	DOREPLIFETIME_CONDITION(APBPlayerCharacter, ReplicatedCapsuleCrouchAlpha, COND_SimulatedOnly);
+	// same for acceleration, autonomous proxies have their own input
+	DOREPLIFETIME_CONDITION(APBPlayerCharacter, ReplicatedAcceleration, COND_SimulatedOnly);
+}
+
+void APBPlayerCharacter::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	if (!MovementPtr)
+	{
+		return;
+	}
+
+	// Compress acceleration: XY as direction and size, Z as is
+	const double MaxAccel = FMath::Max(MovementPtr->MaxAcceleration, UE_KINDA_SMALL_NUMBER);
+	const FVector CurrentAccel = MovementPtr->GetCurrentAcceleration();
+	double AccelXYRadians, AccelXYMagnitude;
+	FMath::CartesianToPolar(CurrentAccel.X, CurrentAccel.Y, AccelXYMagnitude, AccelXYRadians);
+	if (AccelXYRadians < 0.0)
+	{
+		AccelXYRadians += UE_TWO_PI;
+	}
+
+	ReplicatedAcceleration.AccelXYRadians = FMath::Clamp(FMath::RoundToInt(AccelXYRadians / UE_TWO_PI * 255.0), 0, 255);
+	ReplicatedAcceleration.AccelXYMagnitude = FMath::Clamp(FMath::RoundToInt(AccelXYMagnitude / MaxAccel * 255.0), 0, 255);
+	ReplicatedAcceleration.AccelZ = FMath::Clamp(FMath::RoundToInt(CurrentAccel.Z / MaxAccel * 127.0), -127, 127);
+}
+
+void APBPlayerCharacter::OnRep_ReplicatedCrouchAlpha()
+{
+	ApplyProxyCrouchAlpha();
+}
+
+void APBPlayerCharacter::OnRep_ReplicatedAcceleration()
+{
+	if (!MovementPtr)
+	{
+		return;
+	}
+
+	// Decompress acceleration
+	const double MaxAccel = MovementPtr->MaxAcceleration;
+	const double AccelXYMagnitude = double(ReplicatedAcceleration.AccelXYMagnitude) * MaxAccel / 255.0;
+	const double AccelXYRadians = double(ReplicatedAcceleration.AccelXYRadians) * UE_TWO_PI / 255.0;
+
+	FVector UnpackedAcceleration = FVector::ZeroVector;
+	FMath::PolarToCartesian(AccelXYMagnitude, AccelXYRadians, UnpackedAcceleration.X, UnpackedAcceleration.Y);
+	UnpackedAcceleration.Z = double(ReplicatedAcceleration.AccelZ) * MaxAccel / 127.0;
+
+	MovementPtr->SetReplicatedAcceleration(UnpackedAcceleration);
+}
+
+void APBPlayerCharacter::ApplyProxyCrouchAlpha()
+{
+	if (GetLocalRole() != ROLE_SimulatedProxy)
+	{
+		return;
+	}
+
+	// UE-COPY: ACharacter::OnStartCrouch
+	// Our replicated location is the center of the server's capsule, so offset the mesh by how much that capsule has shrunk.
+	// Eyes follow the smooth crouch instead, in RecalculateBaseEyeHeight.
+	const ACharacter* DefaultCharacter = GetClass()->GetDefaultObject<ACharacter>();
+	const float FullCrouchDiff = DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight() - GetCharacterMovement()->GetCrouchedHalfHeight();
+	const float HeightAdjust = FullCrouchDiff * GetReplicatedCapsuleCrouchAlpha();
+	if (GetMesh() && DefaultCharacter->GetMesh())
+	{
+		FVector& MeshRelativeLocation = GetMesh()->GetRelativeLocation_DirectMutable();
+		MeshRelativeLocation.Z = DefaultCharacter->GetMesh()->GetRelativeLocation().Z + HeightAdjust;
+		BaseTranslationOffset.Z = MeshRelativeLocation.Z;
+	}
+	else
+	{
+		BaseTranslationOffset.Z = DefaultCharacter->BaseTranslationOffset.Z + HeightAdjust;
+	}
+	RecalculateBaseEyeHeight();
+}
+
+void APBPlayerCharacter::ResetCharacterState()
+{
+	if (MovementPtr)
+	{
+		MovementPtr->ResetMovementState();
+	}
+
+	// Input and jump state
+	ConsumeMovementInputVector();
+	ResetJumpState();
+	bPressedJump = false;
+	bDeferJumpStop = false;
+	JumpBoostElapsedTime = UE_BIG_NUMBER;
+	JumpBoostElapsedTimePreJump = UE_BIG_NUMBER;
+	bIsSprinting = false;
+	bWantsToWalk = false;
+
+	// Eyes and replicated movement extras
+	BaseEyeHeight = DefaultBaseEyeHeight;
+	ReplicatedCrouchAlpha = 0;
+	ReplicatedCapsuleCrouchAlpha = 0;
+	ReplicatedAcceleration = FPBReplicatedAcceleration();
+
+	if (HasAuthority())
+	{
+		NetUpdateTierLowerTime = 0.0f;
+		LastNetUpdateAcceleration = FVector::ZeroVector;
+		if (bUseAdaptiveNetUpdateFrequency)
+		{
+			NetUpdateTier = EPBNetUpdateTier::Fast;
+			ApplyNetUpdateTier(NetUpdateTier);
+		}
+		ForceNetUpdate();
+	}
+}
+
+void APBPlayerCharacter::CaptureMovementSnapshot(FPBMovementSnapshot& OutSnapshot) const
+{
+	OutSnapshot.JumpKeyHoldTime = JumpKeyHoldTime;
+	OutSnapshot.JumpForceTimeRemaining = JumpForceTimeRemaining;
+	OutSnapshot.JumpBoostElapsedTime = JumpBoostElapsedTime;
+	OutSnapshot.JumpBoostElapsedTimePreJump = JumpBoostElapsedTimePreJump;
+	OutSnapshot.JumpCurrentCount = JumpCurrentCount;
+	OutSnapshot.JumpCurrentCountPreJump = JumpCurrentCountPreJump;
+	OutSnapshot.bIsCrouched = bIsCrouched;
+	OutSnapshot.bPressedJump = bPressedJump;
+	OutSnapshot.bWasJumping = bWasJumping;
+	OutSnapshot.bDeferJumpStop = bDeferJumpStop;
+	OutSnapshot.bIsSprinting = bIsSprinting;
+	OutSnapshot.bWantsToWalk = bWantsToWalk;
+}
+
+void APBPlayerCharacter::RestoreMovementSnapshot(const FPBMovementSnapshot& Snapshot)
+{
+	JumpKeyHoldTime = Snapshot.JumpKeyHoldTime;
+	JumpForceTimeRemaining = Snapshot.JumpForceTimeRemaining;
+	JumpBoostElapsedTime = Snapshot.JumpBoostElapsedTime;
+	JumpBoostElapsedTimePreJump = Snapshot.JumpBoostElapsedTimePreJump;
+	JumpCurrentCount = Snapshot.JumpCurrentCount;
+	JumpCurrentCountPreJump = Snapshot.JumpCurrentCountPreJump;
+	bIsCrouched = Snapshot.bIsCrouched;
+	bPressedJump = Snapshot.bPressedJump;
+	bWasJumping = Snapshot.bWasJumping;
+	bDeferJumpStop = Snapshot.bDeferJumpStop;
+	bIsSprinting = Snapshot.bIsSprinting;
+	bWantsToWalk = Snapshot.bWantsToWalk;
 }
 
 void APBPlayerCharacter::ApplyDamageMomentum(float DamageTaken, FDamageEvent const& DamageEvent, APawn* PawnInstigator, AActor* DamageCauser)
@@ -153,6 +395,13 @@ void APBPlayerCharacter::ApplyDamageMomentum(float DamageTaken, FDamageEvent con
 	}
 }
 
+void APBPlayerCharacter::CheckJumpInput(float DeltaTime)
+{
+	// OnJumped resets the throttle, keep what it was for saved moves to replay the jump from
+	JumpBoostElapsedTimePreJump = JumpBoostElapsedTime;
+	Super::CheckJumpInput(DeltaTime);
+}
+
 void APBPlayerCharacter::ClearJumpInput(float DeltaTime)
 {
 	// Don't clear jump input right away if we're auto hopping or noclipping (holding to go up), or if we are deferring a jump stop
@@ -165,6 +414,9 @@ void APBPlayerCharacter::ClearJumpInput(float DeltaTime)
 
 void APBPlayerCharacter::Jump()
 {
+	NoteSubTickInput();
+	TagInputLatency();
+
 	if (GetCharacterMovement()->IsFalling())
 	{
 		bDeferJumpStop = true;
@@ -200,6 +452,16 @@ void APBPlayerCharacter::OnMovementModeChanged(EMovementMode PrevMovementMode, u
 
 	K2_OnMovementModeChanged(PrevMovementMode, GetCharacterMovement()->MovementMode, PrevCustomMode, GetCharacterMovement()->CustomMovementMode);
 	MovementModeChangedDelegate.Broadcast(this, PrevMovementMode, PrevCustomMode);
+
+	// Jumps and landings are what proxies notice most, so send them right away
+	if (bUseAdaptiveNetUpdateFrequency && HasAuthority() && GetNetMode() != NM_Standalone)
+	{
+		if (!GetCharacterMovement()->IsMovingOnGround() && NetUpdateTier != EPBNetUpdateTier::Fast)
+		{
+			ApplyNetUpdateTier(EPBNetUpdateTier::Fast);
+		}
+		ForceNetUpdate();
+	}
 }
 
 void APBPlayerCharacter::StopJumping()
@@ -212,14 +474,16 @@ void APBPlayerCharacter::StopJumping()
 
 void APBPlayerCharacter::OnJumped_Implementation()
 {
+	MovementPtr->NotifyJumped();
+
 	const int32 JumpBoost = CVarJumpBoost->GetInt();
 	if (MovementPtr->IsOnLadder())
 	{
 		// Implement your own ladder jump off code here
 	}
-	else if (GetWorld()->GetTimeSeconds() >= LastJumpBoostTime + MaxJumpTime && JumpBoost)
+	else if (JumpBoostElapsedTime >= MaxJumpTime && JumpBoost)
 	{
-		LastJumpBoostTime = GetWorld()->GetTimeSeconds();
+		JumpBoostElapsedTime = 0.0f;
 		// Boost forward speed on jump
 		const FVector Facing = GetActorForwardVector();
 		// FVector Input = GetLocalRole() == ROLE_AutonomousProxy ? MovementPtr->GetLastInputVector().GetClampedToMaxSize2D(1.0f) * MovementPtr->GetMaxAcceleration() : GetCharacterMovement()->GetCurrentAcceleration();
@@ -294,16 +558,19 @@ bool APBPlayerCharacter::CanWalkOn(const FHitResult& Hit) const
 
 void APBPlayerCharacter::OnCrouch()
 {
+	NoteSubTickInput();
 	Crouch();
 }
 
 void APBPlayerCharacter::OnUnCrouch()
 {
+	NoteSubTickInput();
 	UnCrouch();
 }
 
 void APBPlayerCharacter::CrouchToggle()
 {
+	NoteSubTickInput();
 	if (GetCharacterMovement()->bWantsToCrouch)
 	{
 		UnCrouch();
@@ -373,10 +640,34 @@ bool APBPlayerCharacter::IsOnLadder() const
 	return false;
 }
 
+void APBPlayerCharacter::NoteSubTickInput()
+{
+	if (InputEventTime > 0.0 && (SubTickInputTime <= 0.0 || InputEventTime < SubTickInputTime))
+	{
+		SubTickInputTime = InputEventTime;
+	}
+}
+
+double APBPlayerCharacter::ConsumeSubTickInputTime()
+{
+	const double Time = SubTickInputTime;
+	SubTickInputTime = 0.0;
+	InputEventTime = 0.0;
+	return Time;
+}
+
 void APBPlayerCharacter::MoveForward(float Val)
 {
+	// Pressing or releasing a direction changes our wish direction, holding it doesn't
+	if (FMath::Sign(Val) != FMath::Sign(LastMoveForwardInput))
+	{
+		NoteSubTickInput();
+	}
+	LastMoveForwardInput = Val;
+
 	if (Val != 0.f)
 	{
+		TagInputLatency();
 		// Limit pitch when walking or falling
 		const bool bLimitRotation = (GetCharacterMovement()->IsMovingOnGround() || GetCharacterMovement()->IsFalling());
 		const FRotator Rotation = bLimitRotation ? GetActorRotation() : Controller->GetControlRotation();
@@ -387,8 +678,15 @@ void APBPlayerCharacter::MoveForward(float Val)
 
 void APBPlayerCharacter::MoveRight(float Val)
 {
+	if (FMath::Sign(Val) != FMath::Sign(LastMoveRightInput))
+	{
+		NoteSubTickInput();
+	}
+	LastMoveRightInput = Val;
+
 	if (Val != 0.f)
 	{
+		TagInputLatency();
 		const FQuat Rotation = GetActorQuat();
 		const FVector Direction = FQuatRotationMatrix(Rotation).GetScaledAxis(EAxis::Y);
 		AddMovementInput(Direction, Val);
@@ -423,11 +721,20 @@ void APBPlayerCharacter::LookUpAtRate(float Val)
 
 void APBPlayerCharacter::AddControllerYawInput(float Val)
 {
+	if (Val != 0.f)
+	{
+		// Turning steers our wish direction
+		TagInputLatency();
+	}
 	Super::AddControllerYawInput(Val);
 }
 
 void APBPlayerCharacter::AddControllerPitchInput(float Val)
 {
+	if (Val != 0.f)
+	{
+		TagInputLatency();
+	}
 	Super::AddControllerPitchInput(Val);
 }
 
@@ -440,6 +747,20 @@ void APBPlayerCharacter::RecalculateBaseEyeHeight()
 	const UCapsuleComponent* CharacterCapsule = GetCapsuleComponent();
 	const float CurrentUnscaledHalfHeight = CharacterCapsule->GetUnscaledCapsuleHalfHeight();
 	const float CurrentAlpha = 1.0f - (CurrentUnscaledHalfHeight - CrouchedHalfHeight) / FullCrouchDiff;
+	if (GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		// Our location follows the server's stepped capsule, so like UPBPlayerMovement::GetCrouchEyeHeightOffset, make up the difference to the smooth crouch
+		const float HalfHeightDiff = (GetReplicatedCapsuleCrouchAlpha() - GetReplicatedCrouchAlpha()) * FullCrouchDiff * CharacterCapsule->GetShapeScale();
+		const bool bMaintainsBase = !MovementPtr || MovementPtr->bCrouchMaintainsBaseLocation;
+		BaseEyeHeight = FMath::Lerp(DefaultCharacter->BaseEyeHeight, CrouchedEyeHeight, SimpleSpline(GetReplicatedCrouchAlpha())) + (bMaintainsBase ? HalfHeightDiff : -HalfHeightDiff);
+		return;
+	}
+	if (MovementPtr)
+	{
+		// The capsule resizes in steps, so follow the smooth crouch and make up the difference
+		BaseEyeHeight = FMath::Lerp(DefaultCharacter->BaseEyeHeight, CrouchedEyeHeight, SimpleSpline(MovementPtr->GetCrouchAlpha())) + MovementPtr->GetCrouchEyeHeightOffset();
+		return;
+	}
 	BaseEyeHeight = FMath::Lerp(DefaultCharacter->BaseEyeHeight, CrouchedEyeHeight, SimpleSpline(CurrentAlpha));
 }
 
@@ -2,35 +2,75 @@
 
 #include "Character/PBPlayerMovement.h"
 
+#include "Camera/PlayerCameraManager.h"
 #include "Components/CapsuleComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/Engine.h"
 #include "Engine/World.h"
 #include "GameFramework/Character.h"
+#include "GameFramework/GameNetworkManager.h"
+#include "GameFramework/PhysicsVolume.h"
+#include "GameFramework/PlayerController.h"
 #include "HAL/IConsoleManager.h"
 #include "Kismet/GameplayStatics.h"
 #include "PhysicalMaterials/PhysicalMaterial.h"
 #include "PhysicsEngine/PhysicsSettings.h"
+#include "ProfilingDebugging/CsvProfiler.h"
 #include "Sound/SoundCue.h"
 
 #if WITH_EDITOR
 #include "DrawDebugHelpers.h"
 #endif
 
+#include "Character/PBMovementSnapshot.h"
+#include "Character/PBMovementValidationSubsystem.h"
 #include "Sound/PBMoveStepSound.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(PBPlayerMovement)
 
 static TAutoConsoleVariable<int32> CVarShowPos(TEXT("cl.ShowPos"), 0, TEXT("Show position and movement information.\n"), ECVF_Default);
 
+static TAutoConsoleVariable<int32> CVarSubTickInput(TEXT("move.SubTickInput"), 0, TEXT("Apply timestamped input changes at the time they happened within a frame, by splitting the frame's move.\n"), ECVF_Default);
+
 static TAutoConsoleVariable<int32> CVarAlwaysApplyFriction(TEXT("move.AlwaysApplyFriction"), 0, TEXT("Apply friction, even in air.\n"), ECVF_Default);
 
 DECLARE_CYCLE_STAT(TEXT("Char StepUp"), STAT_CharStepUp, STATGROUP_Character);
 DECLARE_CYCLE_STAT(TEXT("Char PhysFalling"), STAT_CharPhysFalling, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char StepUp Calls"), STAT_CharStepUpCalls, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char StepUp Sweeps"), STAT_CharStepUpSweeps, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Slide Sweeps"), STAT_CharSlideSweeps, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Ground Snaps"), STAT_CharGroundSnaps, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Floor Cache Hits"), STAT_CharFloorCacheHits, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Saved Move Arena Size"), STAT_CharSavedMoveArenaSize, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Saved Moves Peak In Flight"), STAT_CharSavedMovesPeakInFlight, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Saved Move Arena Overflows"), STAT_CharSavedMoveArenaOverflows, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Corrections Sent"), STAT_CharCorrectionsSent, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Corrections Avoided"), STAT_CharCorrectionsAvoided, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Client Positions Accepted"), STAT_CharClientPositionsAccepted, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Proxy Updates"), STAT_CharProxyUpdates, STATGROUP_Character);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Char Proxy Extrapolation Error"), STAT_CharProxyExtrapolationError, STATGROUP_Character);
+DECLARE_CYCLE_STAT(TEXT("Char Lightweight Proxy Tick"), STAT_CharLightweightProxyTick, STATGROUP_Character);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Char Lightweight Proxies"), STAT_CharLightweightProxies, STATGROUP_Character);
+DECLARE_CYCLE_STAT(TEXT("Char Movement LOD Full"), STAT_CharMovementLODFull, STATGROUP_Character);
+DECLARE_CYCLE_STAT(TEXT("Char Movement LOD Reduced"), STAT_CharMovementLODReduced, STATGROUP_Character);
+DECLARE_CYCLE_STAT(TEXT("Char Movement LOD Minimal"), STAT_CharMovementLODMinimal, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Movement LOD Reduced Count"), STAT_CharMovementLODReducedCount, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Movement LOD Minimal Count"), STAT_CharMovementLODMinimalCount, STATGROUP_Character);
+DECLARE_CYCLE_STAT(TEXT("Char Cosmetics"), STAT_CharCosmetics, STATGROUP_Character);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Char Input To Sim (ms)"), STAT_CharInputToSim, STATGROUP_Character);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Char Input To Server Estimate (ms)"), STAT_CharInputToServer, STATGROUP_Character);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Char Input To Ack (ms)"), STAT_CharInputToAck, STATGROUP_Character);
+DECLARE_CYCLE_STAT(TEXT("Char Lag Compensation Rewind"), STAT_CharLagCompensationRewind, STATGROUP_Character);
+
+CSV_DEFINE_CATEGORY(PBMovement, true);
 
 // MAGIC NUMBERS
 constexpr float JumpVelocity = 266.7f;
 const float MAX_STEP_SIDE_Z = 0.08f;          // maximum z value for the normal on the vertical side of steps
 const float VERTICAL_SLOPE_NORMAL_Z = 0.001f; // Slope is vertical if Abs(Normal.Z) <= this threshold. Accounts for precision problems that sometimes angle
 // normals slightly off horizontal for vertical surface.
+const int32 MAX_CLIP_PLANES = 5;             // Source: MAX_CLIP_PLANES
+const float MIN_SUB_TICK_TIME = 0.001f;     // shortest move either side of a sub-tick input change
 
 #ifndef USE_HL2_GRAVITY
 #define USE_HL2_GRAVITY 1
@@ -76,6 +116,7 @@ UPBPlayerMovement::UPBPlayerMovement()
 	BrakingSubStepTime = 1 / 66.0f;
 	// Time step
 	MaxSimulationTimeStep = 1 / 66.0f;
+	DefaultMaxSimulationTimeStep = MaxSimulationTimeStep;
 	MaxSimulationIterations = 25;
 	MaxJumpApexAttemptsPerSimulation = 4;
 	// Braking deceleration (sv_stopspeed)
@@ -158,6 +199,7 @@ UPBPlayerMovement::UPBPlayerMovement()
 	MinCrouchSlideVelocityBoost = 2.7f;
 	CrouchSlideBoostSlopeFactor = 2.7f;
 	CrouchSlideCooldown = 1.0f;
+	CrouchSlideElapsedTime = UE_BIG_NUMBER;
 #if USE_HL2_GRAVITY
 	// Make sure gravity is correct for player movement
 	GravityScale = DesiredGravity / UPhysicsSettings::Get()->DefaultGravityZ;
@@ -186,6 +228,206 @@ UPBPlayerMovement::UPBPlayerMovement()
 	bEnableServerDualMoveScopedMovementUpdates = true;
 }
 
+void FSavedMove_PB::Clear()
+{
+	Super::Clear();
+	bSavedSprinting = false;
+	bSavedWantsToWalk = false;
+	bSavedLockInCrouch = false;
+	bSavedBrakingFrameTolerated = false;
+	bSavedCrouchFrameTolerated = false;
+	bSavedWasSlidingInAir = false;
+	bSavedInCrouchTransition = false;
+	bSavedCrouchSliding = false;
+	bSavedDeferCrouchSlideToLand = false;
+	SavedBrakingWindowTimeElapsed = 0.0f;
+	SavedSurfaceFriction = 1.0f;
+	SavedCrouchSlideElapsedTime = UE_BIG_NUMBER;
+	SavedJumpBoostElapsedTime = UE_BIG_NUMBER;
+	SavedInputTime = 0.0;
+	SavedSendTime = 0.0;
+}
+
+void FSavedMove_PB::SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData)
+{
+	Super::SetMoveFor(C, InDeltaTime, NewAccel, ClientData);
+	if (APBPlayerCharacter* PBCharacter = Cast<APBPlayerCharacter>(C))
+	{
+		bSavedSprinting = PBCharacter->IsSprinting();
+		bSavedWantsToWalk = PBCharacter->DoesWantToWalk();
+		bSavedLockInCrouch = PBCharacter->GetMovementPtr()->GetCrouchLocked();
+		SaveMovementState(*PBCharacter->GetMovementPtr());
+
+		// Tag the move with the input it's the first to carry, and hand it to the simulation
+		SavedInputTime = PBCharacter->ConsumeInputLatencyTag();
+		PBCharacter->GetMovementPtr()->MoveInputTime = SavedInputTime;
+	}
+}
+
+void FSavedMove_PB::PrepMoveFor(ACharacter* C)
+{
+	Super::PrepMoveFor(C);
+	if (APBPlayerCharacter* PBCharacter = Cast<APBPlayerCharacter>(C))
+	{
+		PBCharacter->SetSprinting(bSavedSprinting);
+		PBCharacter->SetWantsToWalk(bSavedWantsToWalk);
+		PBCharacter->GetMovementPtr()->bLockInCrouch = bSavedLockInCrouch;
+		RestoreMovementState(*PBCharacter->GetMovementPtr());
+	}
+}
+
+void FSavedMove_PB::CombineWith(const FSavedMove_Character* OldMove, ACharacter* InCharacter, APlayerController* PC, const FVector& OldStartLocation)
+{
+	Super::CombineWith(OldMove, InCharacter, PC, OldStartLocation);
+
+	// The combined move starts where the old one did, so go back to its state
+	const FSavedMove_PB* OldPBMove = static_cast<const FSavedMove_PB*>(OldMove);
+	bSavedBrakingFrameTolerated = OldPBMove->bSavedBrakingFrameTolerated;
+	bSavedCrouchFrameTolerated = OldPBMove->bSavedCrouchFrameTolerated;
+	bSavedWasSlidingInAir = OldPBMove->bSavedWasSlidingInAir;
+	bSavedInCrouchTransition = OldPBMove->bSavedInCrouchTransition;
+	bSavedCrouchSliding = OldPBMove->bSavedCrouchSliding;
+	bSavedDeferCrouchSlideToLand = OldPBMove->bSavedDeferCrouchSlideToLand;
+	SavedBrakingWindowTimeElapsed = OldPBMove->SavedBrakingWindowTimeElapsed;
+	SavedSurfaceFriction = OldPBMove->SavedSurfaceFriction;
+	SavedCrouchSlideElapsedTime = OldPBMove->SavedCrouchSlideElapsedTime;
+	SavedJumpBoostElapsedTime = OldPBMove->SavedJumpBoostElapsedTime;
+	// Keep the earlier input, that's the one waiting longest. The old move was never sent, so neither has this one been.
+	if (OldPBMove->SavedInputTime > 0.0)
+	{
+		SavedInputTime = OldPBMove->SavedInputTime;
+	}
+	if (APBPlayerCharacter* PBCharacter = Cast<APBPlayerCharacter>(InCharacter))
+	{
+		RestoreMovementState(*PBCharacter->GetMovementPtr());
+	}
+}
+
+void FSavedMove_PB::SaveMovementState(const UPBPlayerMovement& Movement)
+{
+	bSavedBrakingFrameTolerated = Movement.bBrakingFrameTolerated;
+	bSavedCrouchFrameTolerated = Movement.bCrouchFrameTolerated;
+	bSavedWasSlidingInAir = Movement.bWasSlidingInAir;
+	bSavedInCrouchTransition = Movement.bIsInCrouchTransition;
+	bSavedCrouchSliding = Movement.bCrouchSliding;
+	bSavedDeferCrouchSlideToLand = Movement.bDeferCrouchSlideToLand;
+	SavedBrakingWindowTimeElapsed = Movement.BrakingWindowTimeElapsed;
+	SavedSurfaceFriction = Movement.SurfaceFriction;
+	SavedCrouchSlideElapsedTime = Movement.CrouchSlideElapsedTime;
+	// Moves are saved after CheckJumpInput, so take the throttle from before any jump in this move reset it
+	SavedJumpBoostElapsedTime = Movement.PBPlayerCharacter ? Movement.PBPlayerCharacter->GetJumpBoostElapsedTimePreJump() : UE_BIG_NUMBER;
+}
+
+void FSavedMove_PB::RestoreMovementState(UPBPlayerMovement& Movement) const
+{
+	Movement.bBrakingFrameTolerated = bSavedBrakingFrameTolerated;
+	Movement.bCrouchFrameTolerated = bSavedCrouchFrameTolerated;
+	Movement.bWasSlidingInAir = bSavedWasSlidingInAir;
+	Movement.bIsInCrouchTransition = bSavedInCrouchTransition;
+	Movement.bCrouchSliding = bSavedCrouchSliding;
+	Movement.bDeferCrouchSlideToLand = bSavedDeferCrouchSlideToLand;
+	Movement.BrakingWindowTimeElapsed = SavedBrakingWindowTimeElapsed;
+	Movement.SurfaceFriction = SavedSurfaceFriction;
+	Movement.CrouchSlideElapsedTime = SavedCrouchSlideElapsedTime;
+	if (Movement.PBPlayerCharacter)
+	{
+		Movement.PBPlayerCharacter->SetJumpBoostElapsedTime(SavedJumpBoostElapsedTime);
+	}
+}
+
+bool FSavedMove_PB::CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const
+{
+	const FSavedMove_PB* NewPBMove = static_cast<const FSavedMove_PB*>(NewMove.Get());
+	if (bSavedSprinting != NewPBMove->bSavedSprinting || bSavedWantsToWalk != NewPBMove->bSavedWantsToWalk || bSavedLockInCrouch != NewPBMove->bSavedLockInCrouch)
+	{
+		return false;
+	}
+	return Super::CanCombineWith(NewMove, InCharacter, MaxDelta);
+}
+
+uint8 FSavedMove_PB::GetCompressedFlags() const
+{
+	uint8 Result = Super::GetCompressedFlags();
+	if (bSavedSprinting)
+	{
+		Result |= FLAG_Sprinting;
+	}
+	if (bSavedWantsToWalk)
+	{
+		Result |= FLAG_WantsToWalk;
+	}
+	if (bSavedLockInCrouch)
+	{
+		Result |= FLAG_LockInCrouch;
+	}
+	return Result;
+}
+
+FNetworkPredictionData_Client_PB::FNetworkPredictionData_Client_PB(const UPBPlayerMovement& ClientMovement) : Super(ClientMovement)
+{
+	// Enough moves to cover the worst round trip at the fastest tick rate, plus the pending, important and last acked moves
+	const int32 Capacity = FMath::Clamp(FMath::CeilToInt(ClientMovement.SavedMoveArenaMaxPing * 0.001f * ClientMovement.SavedMoveArenaTickRate), 16, 1024) + 4;
+	// MaxSavedMoveCount stays at the engine's, moves past our capacity come from the heap rather than flushing every saved move
+	MaxFreeMoveCount = Capacity;
+
+	MoveArena.SetNum(Capacity);
+	FreeArenaSlots.Reserve(Capacity);
+	// Warm the free list up front, so the engine never has to ask for a new move
+	FreeMoves.Reserve(Capacity);
+	for (int32 Slot = Capacity - 1; Slot >= 0; --Slot)
+	{
+		FreeMoves.Push(MakeArenaMove(Slot));
+	}
+	INC_DWORD_STAT_BY(STAT_CharSavedMoveArenaSize, Capacity);
+}
+
+FNetworkPredictionData_Client_PB::~FNetworkPredictionData_Client_PB()
+{
+	// Release every move while the arena is still alive
+	SavedMoves.Empty();
+	FreeMoves.Empty();
+	PendingMove = nullptr;
+	LastAckedMove = nullptr;
+	DEC_DWORD_STAT_BY(STAT_CharSavedMoveArenaSize, MoveArena.Num());
+	DEC_DWORD_STAT_BY(STAT_CharSavedMovesPeakInFlight, PeakInFlightMoves);
+}
+
+FSavedMovePtr FNetworkPredictionData_Client_PB::AllocateNewMove()
+{
+	if (FreeArenaSlots.Num() > 0)
+	{
+		return MakeArenaMove(FreeArenaSlots.Pop(EAllowShrinking::No));
+	}
+
+	// Every slot is in flight, so fall back to the heap rather than stalling
+	INC_DWORD_STAT(STAT_CharSavedMoveArenaOverflows);
+	return FSavedMovePtr(new FSavedMove_PB());
+}
+
+FSavedMovePtr FNetworkPredictionData_Client_PB::CreateSavedMove(ACharacter* C, const float DeltaTime, const FVector& NewAccel)
+{
+	FSavedMovePtr NewMove = Super::CreateSavedMove(C, DeltaTime, NewAccel);
+
+	// The new move is about to join the saved moves
+	const int32 InFlightMoves = SavedMoves.Num() + 1;
+	if (InFlightMoves > PeakInFlightMoves)
+	{
+		// Summed over live clients like the arena size, so the two compare directly and a client's share goes when it does
+		INC_DWORD_STAT_BY(STAT_CharSavedMovesPeakInFlight, InFlightMoves - PeakInFlightMoves);
+		PeakInFlightMoves = InFlightMoves;
+	}
+
+	return NewMove;
+}
+
+FSavedMovePtr FNetworkPredictionData_Client_PB::MakeArenaMove(int32 Slot)
+{
+	return MakeShareable<FSavedMove_Character>(&MoveArena[Slot], [this, Slot](FSavedMove_Character* Move) {
+		Move->Clear();
+		FreeArenaSlots.Push(Slot);
+	});
+}
+
 void UPBPlayerMovement::InitializeComponent()
 {
 	Super::InitializeComponent();
@@ -205,6 +447,247 @@ void UPBPlayerMovement::InitializeComponent()
 	}
 	DefaultStepHeight = MaxStepHeight;
 	DefaultWalkableFloorZ = GetWalkableFloorZ();
+	DefaultMaxSimulationTimeStep = MaxSimulationTimeStep;
+	DefaultTickInterval = GetComponentTickInterval();
+	if (bRecordLagCompensationHistory)
+	{
+		LagCompensationHistory.Init(LagCompensationHistorySize);
+	}
+}
+
+void UPBPlayerMovement::ResetMovementState()
+{
+	if (!HasValidData())
+	{
+		return;
+	}
+
+	StopMovementImmediately();
+	ClearAccumulatedForces();
+	Acceleration = FVector::ZeroVector;
+
+	// Stand straight back up, skipping the transition
+	bWantsToCrouch = false;
+	bLockInCrouch = false;
+	bIsInCrouchTransition = false;
+	CrouchAlpha = 0.0f;
+	bCrouchFrameTolerated = false;
+	const ACharacter* DefaultCharacter = CharacterOwner->GetClass()->GetDefaultObject<ACharacter>();
+	const UCapsuleComponent* DefaultCapsule = DefaultCharacter->GetCapsuleComponent();
+	UCapsuleComponent* CharacterCapsule = CharacterOwner->GetCapsuleComponent();
+	const bool bWasCrouched = CharacterOwner->bIsCrouched || CharacterCapsule->GetUnscaledCapsuleHalfHeight() != DefaultCapsule->GetUnscaledCapsuleHalfHeight();
+	CharacterCapsule->SetCapsuleSize(DefaultCapsule->GetUnscaledCapsuleRadius(), DefaultCapsule->GetUnscaledCapsuleHalfHeight());
+	CharacterOwner->bIsCrouched = false;
+	if (bWasCrouched)
+	{
+		CharacterOwner->OnEndCrouch(0.0f, 0.0f);
+	}
+	else
+	{
+		// Never crouched, so no end crouch event, but put the mesh and eyes back in case a transition moved them
+		USkeletalMeshComponent* Mesh = CharacterOwner->GetMesh();
+		const USkeletalMeshComponent* DefaultMesh = DefaultCharacter->GetMesh();
+		if (Mesh && DefaultMesh)
+		{
+			const FVector MeshLocation = Mesh->GetRelativeLocation();
+			Mesh->SetRelativeLocation(FVector(MeshLocation.X, MeshLocation.Y, DefaultMesh->GetRelativeLocation().Z));
+			CharacterOwner->CacheInitialMeshOffset(Mesh->GetRelativeLocation(), Mesh->GetRelativeRotation());
+		}
+		CharacterOwner->RecalculateBaseEyeHeight();
+	}
+
+	// Crouch slide
+	bCrouchSliding = false;
+	bDeferCrouchSlideToLand = false;
+	CrouchSlideElapsedTime = UE_BIG_NUMBER;
+
+	// Ladder
+	bOnLadder = false;
+	OffLadderTicks = LADDER_MOUNT_TIMEOUT;
+
+	// Start out braking
+	bBrakingFrameTolerated = true;
+	BrakingWindowTimeElapsed = 0.0f;
+
+	SurfaceFriction = 1.0f;
+	MaxStepHeight = DefaultStepHeight;
+	SetWalkableFloorZ(DefaultWalkableFloorZ);
+	bHasEverLanded = false;
+	bSlidingInAir = false;
+	bWasSlidingInAir = false;
+	bHasDeferredMovementMode = false;
+	OldBase = nullptr;
+
+	// Resting and floor cache
+	bIsResting = false;
+	IdleTicks = 0;
+	bHasCachedFloor = false;
+	CurrentFloor.Clear();
+
+	// Cosmetics
+	MoveSoundTime = 0.0f;
+	StepSide = false;
+	CosmeticMovementMode = MOVE_None;
+
+	// Networking
+	bAcceptClientPosition = false;
+	ClientPositionAcceptBudget = 0.0f;
+	bHasReplicatedAcceleration = false;
+	ProxyExtrapolationError = 0.0f;
+	bIsLightweightProxy = false;
+	LightweightProxyCheckTime = 0.0f;
+	SetMovementLOD(EPBMovementLOD::Full);
+	AIMovementLODCheckTime = 0.0f;
+	// Shots from before the reset mustn't hit where the old life was
+	LagCompensationHistory.Reset();
+	bValidationDiscontinuity = true;
+	if (ClientPredictionData)
+	{
+		// Moves go back to the arena, the old life's moves mean nothing now
+		ClientPredictionData->SavedMoves.Empty();
+		ClientPredictionData->PendingMove.Reset();
+		ClientPredictionData->LastAckedMove.Reset();
+	}
+
+	SetDefaultMovementMode();
+}
+
+void UPBPlayerMovement::CaptureSnapshot(FPBMovementSnapshot& OutSnapshot) const
+{
+	if (!HasValidData())
+	{
+		return;
+	}
+
+	OutSnapshot.Location = UpdatedComponent->GetComponentLocation();
+	OutSnapshot.Rotation = UpdatedComponent->GetComponentQuat();
+	OutSnapshot.Velocity = Velocity;
+	OutSnapshot.Acceleration = Acceleration;
+	OutSnapshot.CapsuleHalfHeight = CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
+	OutSnapshot.MaxStepHeight = MaxStepHeight;
+	OutSnapshot.WalkableFloorZ = GetWalkableFloorZ();
+	OutSnapshot.SurfaceFriction = SurfaceFriction;
+	OutSnapshot.BrakingWindowTimeElapsed = BrakingWindowTimeElapsed;
+	OutSnapshot.IdleTicks = IdleTicks;
+	OutSnapshot.RestingLocation = RestingLocation;
+	OutSnapshot.RestingOverlapCount = RestingOverlapCount;
+	OutSnapshot.CrouchAlpha = CrouchAlpha;
+	OutSnapshot.CrouchSlideElapsedTime = CrouchSlideElapsedTime;
+	OutSnapshot.OffLadderTicks = OffLadderTicks;
+	OutSnapshot.MovementMode = MovementMode;
+	OutSnapshot.CustomMovementMode = CustomMovementMode;
+	OutSnapshot.DeferredMovementMode = DeferredMovementMode;
+	OutSnapshot.bWantsToCrouch = bWantsToCrouch;
+	OutSnapshot.bLockInCrouch = bLockInCrouch;
+	OutSnapshot.bIsInCrouchTransition = bIsInCrouchTransition;
+	OutSnapshot.bCrouchFrameTolerated = bCrouchFrameTolerated;
+	OutSnapshot.bCrouchSliding = bCrouchSliding;
+	OutSnapshot.bDeferCrouchSlideToLand = bDeferCrouchSlideToLand;
+	OutSnapshot.bOnLadder = bOnLadder;
+	OutSnapshot.bBrakingFrameTolerated = bBrakingFrameTolerated;
+	OutSnapshot.bHasEverLanded = bHasEverLanded;
+	OutSnapshot.bSlidingInAir = bSlidingInAir;
+	OutSnapshot.bWasSlidingInAir = bWasSlidingInAir;
+	OutSnapshot.bHasDeferredMovementMode = bHasDeferredMovementMode;
+	OutSnapshot.bIsResting = bIsResting;
+	if (PBPlayerCharacter)
+	{
+		PBPlayerCharacter->CaptureMovementSnapshot(OutSnapshot);
+	}
+}
+
+void UPBPlayerMovement::RestoreSnapshot(const FPBMovementSnapshot& Snapshot)
+{
+	if (!HasValidData())
+	{
+		return;
+	}
+
+	// Capsule first, so the teleport is checked against the right shape
+	UCapsuleComponent* CharacterCapsule = CharacterOwner->GetCapsuleComponent();
+	if (CharacterCapsule->GetUnscaledCapsuleHalfHeight() != Snapshot.CapsuleHalfHeight)
+	{
+		CharacterCapsule->SetCapsuleSize(CharacterCapsule->GetUnscaledCapsuleRadius(), Snapshot.CapsuleHalfHeight, false);
+	}
+	UpdatedComponent->SetWorldLocationAndRotation(Snapshot.Location, Snapshot.Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+
+	// Mode is set directly, a rollback isn't a mode change and mustn't play sounds or start crouch slides
+	MovementMode = static_cast<EMovementMode>(Snapshot.MovementMode);
+	CustomMovementMode = Snapshot.CustomMovementMode;
+	DeferredMovementMode = static_cast<EMovementMode>(Snapshot.DeferredMovementMode);
+	Velocity = Snapshot.Velocity;
+	Acceleration = Snapshot.Acceleration;
+	MaxStepHeight = Snapshot.MaxStepHeight;
+	SetWalkableFloorZ(Snapshot.WalkableFloorZ);
+	SurfaceFriction = Snapshot.SurfaceFriction;
+	BrakingWindowTimeElapsed = Snapshot.BrakingWindowTimeElapsed;
+	IdleTicks = Snapshot.IdleTicks;
+	RestingLocation = Snapshot.RestingLocation;
+	RestingOverlapCount = Snapshot.RestingOverlapCount;
+	CrouchAlpha = Snapshot.CrouchAlpha;
+	CrouchSlideElapsedTime = Snapshot.CrouchSlideElapsedTime;
+	OffLadderTicks = Snapshot.OffLadderTicks;
+	bWantsToCrouch = Snapshot.bWantsToCrouch;
+	bLockInCrouch = Snapshot.bLockInCrouch;
+	bIsInCrouchTransition = Snapshot.bIsInCrouchTransition;
+	bCrouchFrameTolerated = Snapshot.bCrouchFrameTolerated;
+	bCrouchSliding = Snapshot.bCrouchSliding;
+	bDeferCrouchSlideToLand = Snapshot.bDeferCrouchSlideToLand;
+	bOnLadder = Snapshot.bOnLadder;
+	bBrakingFrameTolerated = Snapshot.bBrakingFrameTolerated;
+	bHasEverLanded = Snapshot.bHasEverLanded;
+	bSlidingInAir = Snapshot.bSlidingInAir;
+	bWasSlidingInAir = Snapshot.bWasSlidingInAir;
+	bHasDeferredMovementMode = Snapshot.bHasDeferredMovementMode;
+	bIsResting = Snapshot.bIsResting;
+	if (PBPlayerCharacter)
+	{
+		PBPlayerCharacter->RestoreMovementSnapshot(Snapshot);
+	}
+	CosmeticMovementMode = MovementMode;
+	bValidationDiscontinuity = true;
+
+	// The floor at the end of a move is the floor found from where it ended
+	bHasCachedFloor = false;
+	if (IsMovingOnGround())
+	{
+		FindFloor(Snapshot.Location, CurrentFloor, false);
+	}
+	else
+	{
+		CurrentFloor.Clear();
+	}
+
+	CharacterOwner->RecalculateBaseEyeHeight();
+	UpdateComponentVelocity();
+}
+
+/** Keep the LOD count stats at how many characters are in each LOD right now */
+static void UpdateMovementLODCountStats(EPBMovementLOD OldLOD, EPBMovementLOD NewLOD)
+{
+	if (OldLOD == EPBMovementLOD::Reduced)
+	{
+		DEC_DWORD_STAT(STAT_CharMovementLODReducedCount);
+	}
+	else if (OldLOD == EPBMovementLOD::Minimal)
+	{
+		DEC_DWORD_STAT(STAT_CharMovementLODMinimalCount);
+	}
+	if (NewLOD == EPBMovementLOD::Reduced)
+	{
+		INC_DWORD_STAT(STAT_CharMovementLODReducedCount);
+	}
+	else if (NewLOD == EPBMovementLOD::Minimal)
+	{
+		INC_DWORD_STAT(STAT_CharMovementLODMinimalCount);
+	}
+}
+
+void UPBPlayerMovement::OnUnregister()
+{
+	// Don't leave a gone character in the LOD counts, or a re-registered one ticking at its old LOD
+	SetMovementLOD(EPBMovementLOD::Full);
+	Super::OnUnregister();
 }
 
 void UPBPlayerMovement::OnRegister()
@@ -218,11 +701,60 @@ void UPBPlayerMovement::OnRegister()
 	}
 }
 
+void UPBPlayerMovement::OnTeleported()
+{
+	Super::OnTeleported();
+
+	// Rewinds mustn't sweep a shot across the gap between where we were and where we were teleported to
+	if (CharacterOwner && CharacterOwner->HasAuthority())
+	{
+		LagCompensationHistory.Reset();
+	}
+}
+
 void UPBPlayerMovement::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	if (CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		UpdateLightweightProxy(DeltaTime);
+	}
+	else if (CharacterOwner && CharacterOwner->HasAuthority())
+	{
+		UpdateAIMovementLOD(DeltaTime);
+	}
+
+	if (CharacterOwner && CharacterOwner->IsLocallyControlled() && PBPlayerCharacter)
+	{
+		DeltaTime = PerformSubTickMove(DeltaTime);
+	}
+
+	{
+		CONDITIONAL_SCOPE_CYCLE_COUNTER(STAT_CharMovementLODFull, MovementLOD == EPBMovementLOD::Full);
+		CONDITIONAL_SCOPE_CYCLE_COUNTER(STAT_CharMovementLODReduced, MovementLOD == EPBMovementLOD::Reduced);
+		CONDITIONAL_SCOPE_CYCLE_COUNTER(STAT_CharMovementLODMinimal, MovementLOD == EPBMovementLOD::Minimal);
+		Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	}
 
-	PlayMoveSound(DeltaTime);
+	// Input state after this frame's move, for the part of the next frame before any input change
+	if (CharacterOwner)
+	{
+		bSubTickPreviousPressedJump = CharacterOwner->bPressedJump;
+		bSubTickPreviousWantsToCrouch = bWantsToCrouch;
+	}
+
+	// Lightweight proxies are too far away or off screen for cosmetics
+	if (bIsLightweightProxy)
+	{
+		INC_DWORD_STAT(STAT_CharLightweightProxies);
+		return;
+	}
+
+#if PB_WITH_COSMETICS
+	if (ShouldRunCosmetics())
+	{
+		PlayMoveSound(DeltaTime);
+	}
+#endif
 
 	if (bHasDeferredMovementMode)
 	{
@@ -236,6 +768,15 @@ void UPBPlayerMovement::TickComponent(float DeltaTime, enum ELevelTick TickType,
 		return;
 	}
 
+#if PB_WITH_COSMETICS
+	if (!ShouldRunCosmetics())
+	{
+		// Simulated proxies only exist on clients, so there's nothing more for a dedicated server
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_CharCosmetics);
+
 	if (bShowPos || CVarShowPos.GetValueOnGameThread() != 0)
 	{
 		const FVector Position = UpdatedComponent->GetComponentLocation();
@@ -245,14 +786,237 @@ void UPBPlayerMovement::TickComponent(float DeltaTime, enum ELevelTick TickType,
 		GEngine->AddOnScreenDebugMessage(2, 1.0f, FColor::Green, FString::Printf(TEXT("ang: %.02f %.02f %.02f"), Rotation.Pitch, Rotation.Yaw, Rotation.Roll));
 		GEngine->AddOnScreenDebugMessage(3, 1.0f, FColor::Green, FString::Printf(TEXT("vel:  %.02f"), Speed));
 	}
+#endif
+
+	// Simulated proxies don't run moves, but still need the braking window for move sounds
+	if (CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		UpdateBrakingWindow(DeltaTime);
+	}
+}
+
+float UPBPlayerMovement::PerformSubTickMove(float DeltaTime)
+{
+	const double Now = FPlatformTime::Seconds();
+	const double WindowStart = LastSubTickWindowTime;
+	const double EventTime = PBPlayerCharacter->ConsumeSubTickInputTime();
+	LastSubTickWindowTime = Now;
+
+	if (CVarSubTickInput.GetValueOnGameThread() == 0 || EventTime <= WindowStart || Now <= WindowStart)
+	{
+		return DeltaTime;
+	}
+	if (!HasValidData() || UpdatedComponent->IsSimulatingPhysics() || ShouldSkipUpdate(DeltaTime) || CharacterOwner->GetLocalRole() < ROLE_AutonomousProxy)
+	{
+		return DeltaTime;
+	}
+
+	const float Fraction = FMath::Clamp((EventTime - WindowStart) / (Now - WindowStart), 0.0, 1.0);
+	const float PreInputTime = DeltaTime * Fraction;
+	if (PreInputTime < MIN_SUB_TICK_TIME || DeltaTime - PreInputTime < MIN_SUB_TICK_TIME)
+	{
+		return DeltaTime;
+	}
+
+	// The part of the frame before the change, with the input we had before it. This is a move of its own,
+	// so the server and replays split the frame at the same point without anything extra in the move packet.
+	const bool bPressedJump = CharacterOwner->bPressedJump;
+	const bool bWantsToCrouchNow = bWantsToCrouch;
+	CharacterOwner->bPressedJump = bSubTickPreviousPressedJump;
+	bWantsToCrouch = bSubTickPreviousWantsToCrouch;
+	ControlledCharacterMove(GetLastInputVector(), PreInputTime);
+	CharacterOwner->bPressedJump = bPressedJump;
+	bWantsToCrouch = bWantsToCrouchNow;
+
+	return DeltaTime - PreInputTime;
+}
+
+EPBMovementLOD UPBPlayerMovement::CalculateAIMovementLOD() const
+{
+	const FVector Location = UpdatedComponent->GetComponentLocation();
+	const float ViewCos = FMath::Cos(FMath::DegreesToRadians(AIMovementLODViewAngle * 0.5f));
+	float ClosestDistSq = MAX_flt;
+	bool bSeen = false;
+	for (FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		const APlayerController* PlayerController = Iterator->Get();
+		if (!PlayerController)
+		{
+			continue;
+		}
+		FVector ViewLocation;
+		FRotator ViewRotation;
+		PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+		const FVector ToUs = Location - ViewLocation;
+		ClosestDistSq = FMath::Min(ClosestDistSq, ToUs.SizeSquared());
+		bSeen |= (ToUs.GetSafeNormal() | ViewRotation.Vector()) >= ViewCos;
+	}
+
+	// A threshold we're already past moves in a little, so an AI walking along one doesn't flip LOD every check
+	const auto ThresholdSq = [this](float Distance, EPBMovementLOD ThresholdLOD)
+	{
+		return FMath::Square(MovementLOD >= ThresholdLOD ? Distance * (1.0f - AIMovementLODHysteresis) : Distance);
+	};
+	if (ClosestDistSq > ThresholdSq(AIMovementLODMinimalDistance, EPBMovementLOD::Minimal))
+	{
+		return EPBMovementLOD::Minimal;
+	}
+	if (ClosestDistSq > ThresholdSq(AIMovementLODReducedDistance, EPBMovementLOD::Reduced) || (!bSeen && ClosestDistSq > ThresholdSq(AIMovementLODNearDistance, EPBMovementLOD::Reduced)))
+	{
+		return EPBMovementLOD::Reduced;
+	}
+	return EPBMovementLOD::Full;
+}
+
+void UPBPlayerMovement::UpdateAIMovementLOD(float DeltaTime)
+{
+	// Only AI is LOD'd, players always get the full simulation
+	const AController* Controller = CharacterOwner->GetController();
+	if (!bUseAIMovementLOD || !Controller || Controller->IsPlayerController() || IsNetMode(NM_Standalone))
+	{
+		if (MovementLOD != EPBMovementLOD::Full)
+		{
+			SetMovementLOD(EPBMovementLOD::Full);
+		}
+		return;
+	}
+
+	AIMovementLODCheckTime -= DeltaTime;
+	if (AIMovementLODCheckTime > 0.0f)
+	{
+		return;
+	}
+	AIMovementLODCheckTime = AIMovementLODCheckInterval;
+
+	const EPBMovementLOD NewLOD = CalculateAIMovementLOD();
+	// Come back from minimal through reduced, so the tick rate and substep don't jump straight from slowest to fastest.
+	// Check again next tick rather than waiting out the interval at reduced.
+	if (MovementLOD == EPBMovementLOD::Minimal && NewLOD == EPBMovementLOD::Full)
+	{
+		SetMovementLOD(EPBMovementLOD::Reduced);
+		AIMovementLODCheckTime = 0.0f;
+		return;
+	}
+	SetMovementLOD(NewLOD);
+}
+
+void UPBPlayerMovement::SetMovementLOD(EPBMovementLOD NewLOD)
+{
+	if (NewLOD == MovementLOD)
+	{
+		return;
+	}
+
+	const bool bMoreRelevant = NewLOD < MovementLOD;
+	UpdateMovementLODCountStats(MovementLOD, NewLOD);
+	MovementLOD = NewLOD;
+	switch (MovementLOD)
+	{
+		case EPBMovementLOD::Full:
+		default:
+			SetComponentTickInterval(DefaultTickInterval);
+			MaxSimulationTimeStep = DefaultMaxSimulationTimeStep;
+			break;
+		case EPBMovementLOD::Reduced:
+			SetComponentTickInterval(ReducedLODTickInterval);
+			MaxSimulationTimeStep = ReducedLODMaxSimulationTimeStep;
+			break;
+		case EPBMovementLOD::Minimal:
+			SetComponentTickInterval(MinimalLODTickInterval);
+			MaxSimulationTimeStep = MinimalLODMaxSimulationTimeStep;
+			break;
+	}
+
+	// Becoming relevant, get players our exact position now rather than at our old update rate
+	if (bMoreRelevant && CharacterOwner)
+	{
+		CharacterOwner->ForceNetUpdate();
+	}
+}
+
+bool UPBPlayerMovement::ShouldBeLightweightProxy() const
+{
+	if (!bUseLightweightProxies || !CharacterOwner || CharacterOwner->GetLocalRole() != ROLE_SimulatedProxy)
+	{
+		return false;
+	}
+
+	// Root motion needs the full simulated tick
+	if (CharacterOwner->IsPlayingNetworkedRootMotionMontage())
+	{
+		return false;
+	}
+
+	if (bLightweightWhenNotRendered && !CharacterOwner->WasRecentlyRendered(LightweightProxyRenderTime))
+	{
+		return true;
+	}
+
+	if (LightweightProxyDistance > 0.0f)
+	{
+		const APlayerController* PlayerController = GEngine->GetFirstLocalPlayerController(GetWorld());
+		if (PlayerController && PlayerController->PlayerCameraManager)
+		{
+			// Come back a little closer than we left, so proxies on the boundary don't flicker between modes
+			const float Distance = bIsLightweightProxy ? LightweightProxyDistance * 0.9f : LightweightProxyDistance;
+			const FVector ViewLocation = PlayerController->PlayerCameraManager->GetCameraLocation();
+			return FVector::DistSquared(ViewLocation, UpdatedComponent->GetComponentLocation()) > FMath::Square(Distance);
+		}
+	}
+
+	return false;
+}
+
+void UPBPlayerMovement::UpdateLightweightProxy(float DeltaTime)
+{
+	LightweightProxyCheckTime -= DeltaTime;
+	// Root motion can't wait for the next check
+	const bool bNeedsFullTick = bIsLightweightProxy && CharacterOwner->IsPlayingNetworkedRootMotionMontage();
+	if (LightweightProxyCheckTime > 0.0f && !bNeedsFullTick)
+	{
+		return;
+	}
+	LightweightProxyCheckTime = LightweightProxyCheckInterval;
+
+	const bool bWasLightweightProxy = bIsLightweightProxy;
+	bIsLightweightProxy = ShouldBeLightweightProxy();
+	if (bWasLightweightProxy && !bIsLightweightProxy)
+	{
+		// Pick the cosmetics back up from where we are, without playing a land or jump for the time we skipped
+		CosmeticMovementMode = MovementMode;
+		bBrakingFrameTolerated = false;
+		BrakingWindowTimeElapsed = 0.0f;
+	}
+}
+
+void UPBPlayerMovement::SimulatedTick(float DeltaSeconds)
+{
+	if (!bIsLightweightProxy || !CharacterOwner || !UpdatedComponent)
+	{
+		Super::SimulatedTick(DeltaSeconds);
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_CharLightweightProxyTick);
 
-	if (RollAngle != 0 && RollSpeed != 0 && GetPBCharacter()->GetController())
+	// UE-COPY: UCharacterMovementComponent::SimulateMovement, without the movement
+	// The capsule is already at the replicated transform and crouch comes from replication, we only need the mode and smoothing
+	if (bNetworkUpdateReceived)
 	{
-		FRotator ControlRotation = GetPBCharacter()->GetController()->GetControlRotation();
-		ControlRotation.Roll = GetCameraRoll();
-		GetPBCharacter()->GetController()->SetControlRotation(ControlRotation);
+		bNetworkUpdateReceived = false;
+		if (bNetworkMovementModeChanged)
+		{
+			ApplyNetworkMovementMode(CharacterOwner->GetReplicatedMovementMode());
+			bNetworkMovementModeChanged = false;
+		}
 	}
+	bJustTeleported = false;
+
+	SmoothClientPosition(DeltaSeconds);
+}
 
+void UPBPlayerMovement::UpdateBrakingWindow(float DeltaTime)
+{
 	if (IsMovingOnGround())
 	{
 		if (!bBrakingFrameTolerated)
@@ -307,7 +1071,10 @@ bool UPBPlayerMovement::DoJump(bool bClientSimulation)
 					FVector InputVector = GetCharacterOwner()->GetPendingMovementInputVector() + GetLastInputVector();
 					InputVector = InputVector.GetSafeNormal2D();
 					Velocity += InputVector * GetMaxAcceleration() * AirJumpDashMagnitude;
-					OnAirJump(NewJumps);
+					if (!IsReplayingMoves())
+					{
+						OnAirJump(NewJumps);
+					}
 				}
 				if (HasCustomGravity())
 				{
@@ -319,50 +1086,226 @@ bool UPBPlayerMovement::DoJump(bool bClientSimulation)
 				}
 				else
 				{
-					if (Velocity.Z < 0.0f)
-					{
-						Velocity.Z = 0.0f;
-					}
-					
-					Velocity.Z += FMath::Max<FVector::FReal>(Velocity.Z, JumpZVelocity);
+					if (Velocity.Z < 0.0f)
+					{
+						Velocity.Z = 0.0f;
+					}
+					
+					Velocity.Z += FMath::Max<FVector::FReal>(Velocity.Z, JumpZVelocity);
+				}
+			}
+			
+			SetMovementMode(MOVE_Falling);
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+float UPBPlayerMovement::GetFallSpeed(bool bAfterLand)
+{
+	FVector FallVelocity = Velocity;
+	if (bAfterLand)
+	{
+		const float GravityStep = GetGravityZ() * GetWorld()->GetDeltaSeconds() * 0.5f;
+		// we need to do another integration step of gravity before we get fall speed
+		if (HasCustomGravity())
+		{
+			SetGravitySpaceZ(FallVelocity, GetGravitySpaceZ(FallVelocity) + GravityStep);
+		}
+		else
+		{
+			FallVelocity.Z += GravityStep;
+		}
+	}
+	return -FallVelocity.Z;
+}
+
+void UPBPlayerMovement::TwoWallAdjust(FVector& Delta, const FHitResult& Hit, const FVector& OldHitNormal) const
+{
+	if (!ShouldClipAgainstPlanes())
+	{
+		Super::TwoWallAdjust(Delta, Hit, OldHitNormal);
+		return;
+	}
+
+	// Clip against both walls at once, rather than adjusting the first slide for the second wall
+	const FVector Planes[2] = {OldHitNormal, GetSlideNormal(Delta, Hit.Normal, Hit)};
+	Delta = ClipToPlanes(Delta, Planes, 2, Delta, 1.0f);
+}
+
+float UPBPlayerMovement::SlideAlongSurface(const FVector& Delta, float Time, const FVector& InNormal, FHitResult& Hit, bool bHandleImpact)
+{
+	if (!ShouldClipAgainstPlanes() || !Hit.bBlockingHit)
+	{
+		return Super::SlideAlongSurface(Delta, Time, InNormal, Hit, bHandleImpact);
+	}
+
+	// Source: CGameMovement::TryPlayerMove
+	// Collect the planes we're touching, and clip against all of them at once, only sweeping again if there's somewhere left to go.
+	const int32 PlaneLimit = FMath::Clamp(MaxClipPlanes, 1, MAX_CLIP_PLANES);
+	FVector Planes[MAX_CLIP_PLANES];
+	int32 NumPlanes = 0;
+	Planes[NumPlanes++] = GetSlideNormal(Delta, InNormal, Hit);
+
+	const FQuat PawnRotation = UpdatedComponent->GetComponentQuat();
+	// The first plane gets the usual slide, with our slope boosting handling
+	FVector SlideDelta = ComputeSlideVector(Delta, Time, Planes[0], Hit);
+	// What we clip against the planes we're stuck on
+	FVector UnclippedDelta = Delta * Time;
+	float PercentTimeApplied = 0.0f;
+
+	for (int32 Bump = 0; Bump < PlaneLimit; ++Bump)
+	{
+		// If we're going nowhere, or back the way we came, stop dead to avoid tiny oscillations in sloping corners
+		if (SlideDelta.IsNearlyZero(1e-3f) || (SlideDelta | Delta) <= 0.0f)
+		{
+			break;
+		}
+
+		SafeMoveUpdatedComponent(SlideDelta, PawnRotation, true, Hit);
+		INC_DWORD_STAT(STAT_CharSlideSweeps);
+		const float HitPercent = Hit.Time * (1.0f - PercentTimeApplied);
+		PercentTimeApplied += HitPercent;
+
+		if (!Hit.IsValidBlockingHit())
+		{
+			break;
+		}
+
+		if (bHandleImpact)
+		{
+			HandleImpact(Hit, HitPercent * Time, SlideDelta);
+		}
+
+		const FVector HitNormal = GetSlideNormal(Delta, Hit.Normal, Hit);
+		if (Hit.Time > 0.0f)
+		{
+			// We covered some distance, so only the new plane restricts the rest of the move
+			NumPlanes = 0;
+			UnclippedDelta = SlideDelta * (1.0f - Hit.Time);
+		}
+		else
+		{
+			// Hit the same plane again without moving, we're wedged
+			bool bDuplicatePlane = false;
+			for (int32 i = 0; i < NumPlanes; ++i)
+			{
+				if ((Planes[i] | HitNormal) > 0.99f)
+				{
+					bDuplicatePlane = true;
+					break;
 				}
 			}
-			
-			SetMovementMode(MOVE_Falling);
-			return true;
+			if (bDuplicatePlane || NumPlanes >= PlaneLimit)
+			{
+				break;
+			}
 		}
+		Planes[NumPlanes++] = HitNormal;
+
+		// Only overbounce off a single surface in the air, like Source
+		const float Overbounce = NumPlanes == 1 && !IsMovingOnGround() ? 1.0f + BounceMultiplier * (1.0f - SurfaceFriction) : 1.0f;
+		SlideDelta = ClipToPlanes(UnclippedDelta, Planes, NumPlanes, Delta, Overbounce);
 	}
-	
-	return false;
+
+	return FMath::Clamp(PercentTimeApplied, 0.0f, 1.0f);
 }
 
-float UPBPlayerMovement::GetFallSpeed(bool bAfterLand)
+bool UPBPlayerMovement::ShouldClipAgainstPlanes() const
 {
-	FVector FallVelocity = Velocity;
-	if (bAfterLand)
+	return bUseMultiPlaneClipping && !HasCustomGravity() && !IsOnLadder() && !bCheatFlying;
+}
+
+FVector UPBPlayerMovement::GetSlideNormal(const FVector& Delta, const FVector& InNormal, const FHitResult& Hit) const
+{
+	// UE-COPY: UCharacterMovementComponent::SlideAlongSurface
+	FVector Normal(InNormal);
+	if (IsMovingOnGround())
 	{
-		const float GravityStep = GetGravityZ() * GetWorld()->GetDeltaSeconds() * 0.5f;
-		// we need to do another integration step of gravity before we get fall speed
-		if (HasCustomGravity())
+		// We don't want to be pushed up an unwalkable surface.
+		if (Normal.Z > 0.0f)
 		{
-			SetGravitySpaceZ(FallVelocity, GetGravitySpaceZ(FallVelocity) + GravityStep);
+			if (!IsWalkable(Hit))
+			{
+				Normal = Normal.GetSafeNormal2D();
+			}
 		}
-		else
+		else if (Normal.Z < -UE_KINDA_SMALL_NUMBER)
 		{
-			FallVelocity.Z += GravityStep;
+			// Don't push down into the floor when the impact is on the upper portion of the capsule.
+			if (CurrentFloor.FloorDist < MIN_FLOOR_DIST && CurrentFloor.bBlockingHit)
+			{
+				const FVector FloorNormal = CurrentFloor.HitResult.Normal;
+				const bool bFloorOpposedToMovement = (Delta | FloorNormal) < 0.0f && (FloorNormal.Z < 1.0f - UE_DELTA);
+				if (bFloorOpposedToMovement)
+				{
+					Normal = FloorNormal;
+				}
+
+				Normal = Normal.GetSafeNormal2D();
+			}
 		}
 	}
-	return -FallVelocity.Z;
+	return Normal;
 }
 
-void UPBPlayerMovement::TwoWallAdjust(FVector& Delta, const FHitResult& Hit, const FVector& OldHitNormal) const
+FVector UPBPlayerMovement::ClipToPlane(const FVector& InVector, const FVector& Normal, float Overbounce)
 {
-	Super::TwoWallAdjust(Delta, Hit, OldHitNormal);
+	// Source: CGameMovement::ClipVelocity
+	const float Backoff = (InVector | Normal) * Overbounce;
+	FVector Out = InVector - Normal * Backoff;
+	// iterate once to make sure we aren't still moving through the plane
+	const float Adjust = Out | Normal;
+	if (Adjust < 0.0f)
+	{
+		Out -= Normal * Adjust;
+	}
+	return Out;
 }
 
-float UPBPlayerMovement::SlideAlongSurface(const FVector& Delta, float Time, const FVector& Normal, FHitResult& Hit, bool bHandleImpact)
+FVector UPBPlayerMovement::ClipToPlanes(const FVector& InVector, const FVector* Planes, int32 NumPlanes, const FVector& PrimalVector, float Overbounce)
 {
-	return Super::SlideAlongSurface(Delta, Time, Normal, Hit, bHandleImpact);
+	if (NumPlanes == 1)
+	{
+		return ClipToPlane(InVector, Planes[0], Overbounce);
+	}
+
+	FVector Clipped = FVector::ZeroVector;
+	bool bFoundPlane = false;
+	for (int32 i = 0; i < NumPlanes && !bFoundPlane; ++i)
+	{
+		Clipped = ClipToPlane(InVector, Planes[i], 1.0f);
+		bFoundPlane = true;
+		for (int32 j = 0; j < NumPlanes; ++j)
+		{
+			// Are we now moving against this plane?
+			if (j != i && (Clipped | Planes[j]) < 0.0f)
+			{
+				bFoundPlane = false;
+				break;
+			}
+		}
+	}
+
+	if (!bFoundPlane)
+	{
+		// Go along the crease, if there's only one
+		if (NumPlanes != 2)
+		{
+			return FVector::ZeroVector;
+		}
+		const FVector Dir = (Planes[0] ^ Planes[1]).GetSafeNormal();
+		Clipped = Dir * (Dir | Clipped);
+	}
+
+	// If we'd be going against our original direction, stop dead to avoid tiny oscillations in sloping corners
+	if ((Clipped | PrimalVector) <= 0.0f)
+	{
+		return FVector::ZeroVector;
+	}
+	return Clipped;
 }
 
 FVector UPBPlayerMovement::ComputeSlideVector(const FVector& Delta, const float Time, const FVector& Normal, const FHitResult& Hit) const
@@ -399,6 +1342,290 @@ FVector UPBPlayerMovement::HandleSlopeBoosting(const FVector& SlideResult, const
 	return (Delta - BounceCoefficient * Delta.ProjectOnToNormal(ImpactNormal)) * Time;
 }
 
+bool UPBPlayerMovement::StepUp(const FVector& GravDir, const FVector& Delta, const FHitResult& InHit, FStepDownResult* OutStepDownResult)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CharStepUp);
+	INC_DWORD_STAT(STAT_CharStepUpCalls);
+
+	// Count every sweep either version makes, so their costs can be compared
+	const uint32 SweepsBefore = StepUpSweepCount;
+	bool bSteppedUp;
+	{
+		TGuardValue<bool> CountSweeps(bCountingStepUpSweeps, true);
+		if (!bUseSourceStepUp || HasCustomGravity() || IsOnLadder() || bCheatFlying)
+		{
+			bSteppedUp = Super::StepUp(GravDir, Delta, InHit, OutStepDownResult);
+		}
+		else
+		{
+			bSteppedUp = SourceStepUp(GravDir, Delta, InHit, OutStepDownResult);
+		}
+	}
+	INC_DWORD_STAT_BY(STAT_CharStepUpSweeps, StepUpSweepCount - SweepsBefore);
+	return bSteppedUp;
+}
+
+bool UPBPlayerMovement::SourceStepUp(const FVector& GravDir, const FVector& Delta, const FHitResult& InHit, FStepDownResult* OutStepDownResult)
+{
+	// Source: CGameMovement::StepMove
+	// Trace up, forward, then down. A forward sweep that gets partway slides the rest once, so at most four sweeps.
+	// The engine version slides as often as it needs to and re-finds the floor on top of this.
+	if (!CanStepUp(InHit) || MaxStepHeight <= 0.0f)
+	{
+		return false;
+	}
+
+	const FVector OldLocation = UpdatedComponent->GetComponentLocation();
+	float PawnRadius, PawnHalfHeight;
+	CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleSize(PawnRadius, PawnHalfHeight);
+
+	// Don't bother stepping up if top of capsule is hitting something.
+	const float InitialImpactZ = InHit.ImpactPoint.Z;
+	if (InitialImpactZ > OldLocation.Z + (PawnHalfHeight - PawnRadius))
+	{
+		return false;
+	}
+
+	// Our dynamic step height scales down with speed, keep it within the designer's bounds
+	const float StepHeight = FMath::Clamp(MaxStepHeight, FMath::Min(MinStepHeight, DefaultStepHeight), DefaultStepHeight);
+
+	float StepTravelUpHeight = StepHeight;
+	float PawnInitialFloorBaseZ = OldLocation.Z - PawnHalfHeight;
+	float PawnFloorPointZ = PawnInitialFloorBaseZ;
+
+	if (IsMovingOnGround() && CurrentFloor.IsWalkableFloor())
+	{
+		// Since we float a variable amount off the floor, we need to enforce max step height off the actual point of impact with the floor.
+		const float FloorDist = FMath::Max(0.0f, CurrentFloor.GetDistanceToFloor());
+		PawnInitialFloorBaseZ -= FloorDist;
+		StepTravelUpHeight = FMath::Max(StepTravelUpHeight - FloorDist, 0.0f);
+
+		const bool bHitVerticalFace = !IsWithinEdgeTolerance(InHit.Location, InHit.ImpactPoint, PawnRadius);
+		if (!CurrentFloor.bLineTrace && !bHitVerticalFace)
+		{
+			PawnFloorPointZ = CurrentFloor.HitResult.ImpactPoint.Z;
+		}
+		else
+		{
+			// Base floor point is the base of the capsule moved down by how far we are hovering over the surface we are hitting.
+			PawnFloorPointZ -= CurrentFloor.FloorDist;
+		}
+	}
+
+	// Don't step up if the impact is below us, accounting for distance from floor.
+	if (InitialImpactZ <= PawnInitialFloorBaseZ)
+	{
+		return false;
+	}
+
+	// Come back down by what we went up, plus however far we're allowed to step down on the other side
+	const float StepTravelDownHeight = StepTravelUpHeight + FMath::Max(StepHeight * StepDownHeightFraction, MAX_FLOOR_DIST * 2.0f);
+
+	// Scope our movement updates, and do not apply them until all intermediate moves are completed.
+	FScopedMovementUpdate ScopedStepUpMovement(UpdatedComponent, EScopedUpdate::DeferredUpdates);
+	const FQuat PawnRotation = UpdatedComponent->GetComponentQuat();
+
+	// step up
+	FHitResult SweepUpHit(1.0f);
+	MoveUpdatedComponent(-GravDir * StepTravelUpHeight, PawnRotation, true, &SweepUpHit);
+	if (SweepUpHit.bStartPenetrating)
+	{
+		ScopedStepUpMovement.RevertMove();
+		return false;
+	}
+
+	// step forward
+	FHitResult Hit(1.0f);
+	MoveUpdatedComponent(Delta, PawnRotation, true, &Hit);
+	if (Hit.bBlockingHit)
+	{
+		// Blocked straight away, let the caller slide along the step face instead
+		if (Hit.bStartPenetrating || Hit.Time == 0.0f)
+		{
+			ScopedStepUpMovement.RevertMove();
+			return false;
+		}
+		if (SweepUpHit.bBlockingHit)
+		{
+			HandleImpact(SweepUpHit);
+		}
+		HandleImpact(Hit);
+		if (IsFalling())
+		{
+			return true;
+		}
+		// Source: TryPlayerMove in StepMove. We got partway, slide the rest of the move along what we hit up here,
+		// since the caller only slides when we fail and the rest of Delta would be lost.
+		// One sweep along it, where SlideAlongSurface could sweep once per plane it finds.
+		const FVector SlideDelta = ComputeSlideVector(Delta, 1.0f - Hit.Time, GetSlideNormal(Delta, Hit.Normal, Hit), Hit);
+		if ((SlideDelta | Delta) > 0.0f)
+		{
+			FHitResult SlideHit(1.0f);
+			MoveUpdatedComponent(SlideDelta, PawnRotation, true, &SlideHit);
+			if (SlideHit.IsValidBlockingHit())
+			{
+				HandleImpact(SlideHit, SlideHit.Time, SlideDelta);
+			}
+			// Handling the impact can launch us or change our mode, say a trigger or damaging wall, then this isn't a step
+			if (IsFalling())
+			{
+				ScopedStepUpMovement.RevertMove();
+				return false;
+			}
+		}
+	}
+
+	// step down
+	FHitResult DownHit(1.0f);
+	MoveUpdatedComponent(GravDir * StepTravelDownHeight, PawnRotation, true, &DownHit);
+
+	// If step down was initially penetrating abort the step up
+	if (DownHit.bStartPenetrating)
+	{
+		ScopedStepUpMovement.RevertMove();
+		return false;
+	}
+
+	FStepDownResult StepDownResult;
+	if (DownHit.IsValidBlockingHit())
+	{
+		// See if this step sequence would have allowed us to travel higher than our max step height allows.
+		const float DeltaZ = DownHit.ImpactPoint.Z - PawnFloorPointZ;
+		if (DeltaZ > StepHeight)
+		{
+			ScopedStepUpMovement.RevertMove();
+			return false;
+		}
+
+		const bool bWalkable = IsWalkable(DownHit);
+		if (!bWalkable)
+		{
+			// Reject if normal opposes movement direction, or if we would end up higher than where we started.
+			// It's fine to step down onto an unwalkable normal below us, we will just slide off.
+			if ((Delta | DownHit.ImpactNormal) < 0.0f || DownHit.Location.Z > OldLocation.Z)
+			{
+				ScopedStepUpMovement.RevertMove();
+				return false;
+			}
+		}
+
+		// Reject moves where the downward sweep hit something very close to the edge of the capsule. This maintains consistency with FindFloor as well.
+		if (!IsWithinEdgeTolerance(DownHit.Location, DownHit.ImpactPoint, PawnRadius))
+		{
+			ScopedStepUpMovement.RevertMove();
+			return false;
+		}
+
+		// Don't step up onto invalid surfaces if traveling higher.
+		if (DeltaZ > 0.0f && !CanStepUp(DownHit))
+		{
+			ScopedStepUpMovement.RevertMove();
+			return false;
+		}
+
+		// The down sweep is a vertical floor sweep, so use it as our floor rather than finding it again.
+		// This is the same result FindFloor gives when handed a downward sweep.
+		if (OutStepDownResult)
+		{
+			const float FloorDist = UpdatedComponent->GetComponentLocation().Z - DownHit.Location.Z;
+			StepDownResult.FloorResult.SetFromSweep(DownHit, FloorDist, bWalkable);
+			StepDownResult.bComputedFloor = true;
+		}
+	}
+
+	// Copy step down result.
+	if (OutStepDownResult)
+	{
+		*OutStepDownResult = StepDownResult;
+	}
+
+	// Don't recalculate velocity based on this height adjustment, if considering vertical adjustments.
+	bJustTeleported |= !bMaintainHorizontalGroundVelocity;
+
+	return true;
+}
+
+void UPBPlayerMovement::FindFloor(const FVector& CapsuleLocation, FFindFloorResult& OutFloorResult, bool bCanUseCachedLocation, const FHitResult* DownwardSweepResult) const
+{
+	// Step up hands us its own sweep. bAlwaysCheckFloor makes the engine run a full check even when told it can use the cached
+	// location, so those calls come through here too and reuse our cache below when we haven't moved.
+	if (!bUseGroundSnapping || DownwardSweepResult || !IsMovingOnGround() || HasCustomGravity() || !CanWalkOffLedges() ||
+		!UpdatedComponent->IsQueryCollisionEnabled())
+	{
+		bHasCachedFloor = false;
+		Super::FindFloor(CapsuleLocation, OutFloorResult, bCanUseCachedLocation, DownwardSweepResult);
+		return;
+	}
+
+	const float PawnHalfHeight = CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+	if (bHasCachedFloor && !bForceNextFloorCheck && !bJustTeleported && CachedFloorLocation.Equals(CapsuleLocation) && CachedFloorHalfHeight == PawnHalfHeight)
+	{
+		// Only trust the cache if the floor can't have moved since
+		const UPrimitiveComponent* FloorComponent = CachedFloor.HitResult.GetComponent();
+		if (!CachedFloor.bBlockingHit || (FloorComponent && FloorComponent->Mobility != EComponentMobility::Movable && !MovementBaseUtility::IsDynamicBase(GetMovementBase())))
+		{
+			INC_DWORD_STAT(STAT_CharFloorCacheHits);
+			OutFloorResult = CachedFloor;
+			return;
+		}
+	}
+
+	UPBPlayerMovement* MutableThis = const_cast<UPBPlayerMovement*>(this);
+	MutableThis->bForceNextFloorCheck = false;
+
+	if (!SnapToGround(CapsuleLocation, OutFloorResult))
+	{
+		Super::FindFloor(CapsuleLocation, OutFloorResult, false, nullptr);
+	}
+
+	bHasCachedFloor = true;
+	CachedFloorLocation = CapsuleLocation;
+	CachedFloorHalfHeight = PawnHalfHeight;
+	CachedFloor = OutFloorResult;
+}
+
+bool UPBPlayerMovement::SnapToGround(const FVector& CapsuleLocation, FFindFloorResult& OutFloorResult) const
+{
+	float PawnRadius, PawnHalfHeight;
+	CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleSize(PawnRadius, PawnHalfHeight);
+
+	// Only look as far down as we're allowed to step down, anything further is a fall
+	const float SnapDist = MaxStepHeight * StepDownHeightFraction + MAX_FLOOR_DIST;
+
+	// UE-COPY: UCharacterMovementComponent::ComputeFloorDist
+	// Reduce height of the capsule so we don't hit walls we're touching
+	const float ShrinkScale = 0.9f;
+	const float ShrinkHeight = (PawnHalfHeight - PawnRadius) * (1.0f - ShrinkScale);
+	const float TraceDist = SnapDist + ShrinkHeight;
+	const FCollisionShape CapsuleShape = FCollisionShape::MakeCapsule(PawnRadius, PawnHalfHeight - ShrinkHeight);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(GroundSnap), false, CharacterOwner);
+	FCollisionResponseParams ResponseParam;
+	InitCollisionParams(QueryParams, ResponseParam);
+	const ECollisionChannel CollisionChannel = UpdatedComponent->GetCollisionObjectType();
+
+	FHitResult Hit(1.0f);
+	const bool bBlockingHit = FloorSweepTest(Hit, CapsuleLocation, CapsuleLocation + FVector(0.0f, 0.0f, -TraceDist), CollisionChannel, CapsuleShape, QueryParams, ResponseParam);
+	INC_DWORD_STAT(STAT_CharGroundSnaps);
+
+	OutFloorResult.Clear();
+	if (!bBlockingHit)
+	{
+		// Nothing within step down height, PhysWalking will hand off to falling
+		return true;
+	}
+
+	// Penetration, edges and perching all need the full floor find to resolve
+	if (Hit.bStartPenetrating || !IsWalkable(Hit) || !IsWithinEdgeTolerance(CapsuleLocation, Hit.ImpactPoint, CapsuleShape.Capsule.Radius) || ShouldComputePerchResult(Hit))
+	{
+		return false;
+	}
+
+	const float FloorDist = FMath::Max(0.0f, Hit.Time * TraceDist - ShrinkHeight);
+	OutFloorResult.SetFromSweep(Hit, FloorDist, true);
+	return true;
+}
+
 bool UPBPlayerMovement::ShouldCatchAir(const FFindFloorResult& OldFloor, const FFindFloorResult& NewFloor)
 {
 	// If the new floor is below the old floor by fraction of max step height, catch air
@@ -495,6 +1722,10 @@ void UPBPlayerMovement::OnMovementModeChanged(EMovementMode PreviousMovementMode
 	// Reset step side if we are changing modes
 	StepSide = false;
 
+	// Any mode change needs a full floor check
+	StopResting();
+	bHasCachedFloor = false;
+
 	// did we jump or land
 	bool bJumped = false;
 	bool bQueueJumpSound = false;
@@ -546,12 +1777,19 @@ void UPBPlayerMovement::OnMovementModeChanged(EMovementMode PreviousMovementMode
 				bHasEverLanded = true;
 			}
 		}
-		if (bHasEverLanded)
+		// Replays play their net result once they're done
+		if (bHasEverLanded && !IsReplayingMoves())
 		{
+#if PB_WITH_COSMETICS
 			// If we have found an initial ground from when we did our initial player spawn, we can play a sound.
-			FHitResult Hit;
-			TraceCharacterFloor(Hit);
-			PlayJumpSound(Hit, bJumped);
+			if (ShouldRunCosmetics())
+			{
+				SCOPE_CYCLE_COUNTER(STAT_CharCosmetics);
+				FHitResult Hit;
+				TraceCharacterFloor(Hit);
+				PlayJumpSound(Hit, bJumped);
+			}
+#endif
 			bDidPlayJumpSound = true;
 		}
 	}
@@ -573,15 +1811,20 @@ void UPBPlayerMovement::OnMovementModeChanged(EMovementMode PreviousMovementMode
 			bHasEverLanded = true;
 		}
 	}
+
+	if (!IsReplayingMoves())
+	{
+		CosmeticMovementMode = MovementMode;
+	}
 }
 
-float UPBPlayerMovement::GetCameraRoll()
+float UPBPlayerMovement::GetCameraRoll() const
 {
-	if (RollSpeed == 0.0f || RollAngle == 0.0f)
+	if (RollSpeed == 0.0f || RollAngle == 0.0f || !CharacterOwner)
 	{
 		return 0.0f;
 	}
-	float Side = Velocity | FRotationMatrix(GetCharacterOwner()->GetControlRotation()).GetScaledAxis(EAxis::Y);
+	float Side = Velocity | FRotationMatrix(CharacterOwner->GetViewRotation()).GetScaledAxis(EAxis::Y);
 	const float Sign = FMath::Sign(Side);
 	Side = FMath::Abs(Side);
 	if (Side < RollSpeed)
@@ -661,10 +1904,8 @@ void UPBPlayerMovement::ApplyVelocityBraking(float DeltaTime, float Friction, fl
 #endif
 		if (Friction > 1.0f)
 		{
-			float CurrentTime = GetWorld()->GetTimeSeconds();
-			float TimeDifference = CurrentTime - CrouchSlideStartTime;
 			// Decay friction reduction
-			Friction = FMath::Lerp(1.0f, Friction, FMath::Clamp(TimeDifference / CrouchSlideBoostTime, 0.0f, 1.0f));
+			Friction = FMath::Lerp(1.0f, Friction, FMath::Clamp(CrouchSlideElapsedTime / CrouchSlideBoostTime, 0.0f, 1.0f));
 		}
 		BrakingDeceleration = FMath::Max(10.0f, Speed);
 #if DIRECTIONAL_BRAKING
@@ -741,30 +1982,128 @@ bool UPBPlayerMovement::ShouldLimitAirControl(float DeltaTime, const FVector& Fa
 	return false;
 }
 
-FVector UPBPlayerMovement::NewFallVelocity(const FVector& InitialVelocity, const FVector& Gravity, float DeltaTime) const
-{
-	FVector FallVel = Super::NewFallVelocity(InitialVelocity, Gravity, DeltaTime);
-	FallVel.Z = FMath::Clamp(FallVel.Z, -AxisSpeedLimit, AxisSpeedLimit);
-	return FallVel;
+FVector UPBPlayerMovement::NewFallVelocity(const FVector& InitialVelocity, const FVector& Gravity, float DeltaTime) const
+{
+	FVector FallVel = Super::NewFallVelocity(InitialVelocity, Gravity, DeltaTime);
+	FallVel.Z = FMath::Clamp(FallVel.Z, -AxisSpeedLimit, AxisSpeedLimit);
+	return FallVel;
+}
+
+void UPBPlayerMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
+{
+	// Before crouching, so a crouch slide starting this move sees no time elapsed
+	CrouchSlideElapsedTime = FMath::Min(CrouchSlideElapsedTime + DeltaSeconds, UE_BIG_NUMBER);
+	if (PBPlayerCharacter)
+	{
+		PBPlayerCharacter->AdvanceJumpBoostTime(DeltaSeconds);
+	}
+	Super::UpdateCharacterStateBeforeMovement(DeltaSeconds);
+	Velocity.Z = FMath::Clamp(Velocity.Z, -AxisSpeedLimit, AxisSpeedLimit);
+	// reset value for new frame
+	bSlidingInAir = false;
+	UpdateCrouching(DeltaSeconds);
+}
+
+void UPBPlayerMovement::UpdateCharacterStateAfterMovement(float DeltaSeconds)
+{
+	Super::UpdateCharacterStateAfterMovement(DeltaSeconds);
+	Velocity.Z = FMath::Clamp(Velocity.Z, -AxisSpeedLimit, AxisSpeedLimit);
+	// Resting means our floor hasn't changed, so neither has its friction
+	if (!bIsResting)
+	{
+		UpdateSurfaceFriction(bSlidingInAir);
+	}
+	// forward to the next frame
+	bWasSlidingInAir = bSlidingInAir;
+	UpdateCrouching(DeltaSeconds, true);
+	UpdateBrakingWindow(DeltaSeconds);
+	if (CharacterOwner->HasAuthority() && PBPlayerCharacter)
+	{
+		PBPlayerCharacter->SetReplicatedCrouchAlpha(GetCrouchAlpha(), GetCapsuleCrouchAlpha());
+	}
+	if (bRecordLagCompensationHistory && CharacterOwner->HasAuthority())
+	{
+		// Every move a frame makes lands on the same time, so this keeps where the frame ended
+		LagCompensationHistory.Record(GetWorld()->GetTimeSeconds(), UpdatedComponent->GetComponentLocation(), CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight(), GetCrouchAlpha());
+	}
+}
+
+bool UPBPlayerMovement::GetLagCompensatedCapsule(double Time, FPBLagCompensationSample& OutSample) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_CharLagCompensationRewind);
+	return LagCompensationHistory.Rewind(Time, OutSample);
+}
+
+void UPBPlayerMovement::RewindCapsules(TConstArrayView<FPBLagCompensationQuery> Queries, TArrayView<FPBLagCompensationSample> OutSamples, TBitArray<>& OutRewound)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CharLagCompensationRewind);
+	check(OutSamples.Num() >= Queries.Num());
+	OutRewound.Init(false, Queries.Num());
+	for (int32 i = 0; i < Queries.Num(); i++)
+	{
+		const FPBLagCompensationQuery& Query = Queries[i];
+		if (Query.Movement)
+		{
+			OutRewound[i] = Query.Movement->LagCompensationHistory.Rewind(Query.Time, OutSamples[i]);
+		}
+	}
+}
+
+bool UPBPlayerMovement::CanRest() const
+{
+	if (!bAllowResting || !IsMovingOnGround() || bCheatFlying || IsOnLadder() || bIsInCrouchTransition || bCrouchSliding || bHasDeferredMovementMode)
+	{
+		return false;
+	}
+
+	// Any input, impulse or pending floor check means we have work to do
+	if (!Velocity.IsZero() || !Acceleration.IsZero() || !PendingImpulseToApply.IsZero() || !PendingForceToApply.IsZero() || bForceNextFloorCheck || bJustTeleported)
+	{
+		return false;
+	}
+
+	if (HasAnimRootMotion() || CurrentRootMotion.HasActiveRootMotionSources() || !CurrentFloor.IsWalkableFloor())
+	{
+		return false;
+	}
+
+	// Only rest on bases that can't move out from under us. This also fails if our base was destroyed.
+	const UPrimitiveComponent* FloorComponent = CurrentFloor.HitResult.GetComponent();
+	return FloorComponent && FloorComponent->Mobility != EComponentMobility::Movable && !MovementBaseUtility::IsDynamicBase(GetMovementBase());
 }
 
-void UPBPlayerMovement::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
+void UPBPlayerMovement::StopResting()
 {
-	Super::UpdateCharacterStateBeforeMovement(DeltaSeconds);
-	Velocity.Z = FMath::Clamp(Velocity.Z, -AxisSpeedLimit, AxisSpeedLimit);
-	// reset value for new frame
-	bSlidingInAir = false;
-	UpdateCrouching(DeltaSeconds);
+	bIsResting = false;
+	IdleTicks = 0;
 }
 
-void UPBPlayerMovement::UpdateCharacterStateAfterMovement(float DeltaSeconds)
+void UPBPlayerMovement::PhysWalking(float deltaTime, int32 Iterations)
 {
-	Super::UpdateCharacterStateAfterMovement(DeltaSeconds);
-	Velocity.Z = FMath::Clamp(Velocity.Z, -AxisSpeedLimit, AxisSpeedLimit);
-	UpdateSurfaceFriction(bSlidingInAir);
-	// forward to the next frame
-	bWasSlidingInAir = bSlidingInAir;
-	UpdateCrouching(DeltaSeconds, true);
+	if (bIsResting)
+	{
+		// Validate that nothing has moved or touched us since we came to rest
+		if (CanRest() && UpdatedComponent->GetComponentLocation().Equals(RestingLocation) && UpdatedPrimitive->GetOverlapInfos().Num() == RestingOverlapCount)
+		{
+			return;
+		}
+		StopResting();
+	}
+
+	Super::PhysWalking(deltaTime, Iterations);
+
+	if (!CanRest())
+	{
+		IdleTicks = 0;
+		return;
+	}
+
+	if (++IdleTicks >= RestingTickThreshold)
+	{
+		bIsResting = true;
+		RestingLocation = UpdatedComponent->GetComponentLocation();
+		RestingOverlapCount = UpdatedPrimitive->GetOverlapInfos().Num();
+	}
 }
 
 void UPBPlayerMovement::UpdateSurfaceFriction(bool bIsSliding)
@@ -846,9 +2185,8 @@ void UPBPlayerMovement::UpdateCrouching(float DeltaTime, bool bOnlyUncrouch)
 
 void UPBPlayerMovement::StartCrouchSlide()
 {
-	float CurrentTime = GetWorld()->GetTimeSeconds();
 	// Don't boost again if we are already boosting
-	if (IsCrouchSliding() || CurrentTime - CrouchSlideStartTime <= CrouchSlideCooldown)
+	if (IsCrouchSliding() || CrouchSlideElapsedTime <= CrouchSlideCooldown)
 	{
 		// Continue crouch sliding if we're going that fast
 		if (Velocity.SizeSquared2D() >= MinCrouchSlideBoost * MinCrouchSlideBoost)
@@ -868,7 +2206,7 @@ void UPBPlayerMovement::StartCrouchSlide()
 	}
 	Velocity = NewSpeed * Velocity.GetSafeNormal2D();
 	// Set the time
-	CrouchSlideStartTime = CurrentTime;
+	CrouchSlideElapsedTime = 0.0f;
 	bCrouchSliding = true;
 }
 
@@ -883,6 +2221,236 @@ void UPBPlayerMovement::StopCrouchSliding()
 	bDeferCrouchSlideToLand = false;
 }
 
+FNetworkPredictionData_Client* UPBPlayerMovement::GetPredictionData_Client() const
+{
+	if (ClientPredictionData == nullptr)
+	{
+		UPBPlayerMovement* MutableThis = const_cast<UPBPlayerMovement*>(this);
+		MutableThis->ClientPredictionData = new FNetworkPredictionData_Client_PB(*this);
+	}
+
+	return ClientPredictionData;
+}
+
+bool UPBPlayerMovement::ClientUpdatePositionAfterServerUpdate()
+{
+	// The engine sets bClientUpdating on our character while it replays, see IsReplayingMoves
+	const bool bResult = Super::ClientUpdatePositionAfterServerUpdate();
+
+	// Play the jump or land the replay ended up with, rather than one for every replayed move
+	if (MovementMode != CosmeticMovementMode)
+	{
+		const bool bJumped = CosmeticMovementMode == MOVE_Walking && MovementMode == MOVE_Falling && Velocity.Z > 0.0f;
+		const bool bLanded = CosmeticMovementMode == MOVE_Falling && MovementMode == MOVE_Walking;
+		if ((bJumped || bLanded) && bHasEverLanded && !bHasDeferredMovementMode && ShouldRunCosmetics())
+		{
+			SCOPE_CYCLE_COUNTER(STAT_CharCosmetics);
+			FHitResult Hit;
+			TraceCharacterFloor(Hit);
+			PlayJumpSound(Hit, bJumped);
+		}
+		CosmeticMovementMode = MovementMode;
+	}
+
+	return bResult;
+}
+
+void UPBPlayerMovement::SetReplicatedAcceleration(const FVector& InAcceleration)
+{
+	bHasReplicatedAcceleration = true;
+	Acceleration = InAcceleration;
+}
+
+void UPBPlayerMovement::SimulateMovement(float DeltaTime)
+{
+	if (!bHasReplicatedAcceleration)
+	{
+		Super::SimulateMovement(DeltaTime);
+		return;
+	}
+
+	// Preserve our replicated acceleration, the engine makes one up from velocity
+	const FVector OriginalAcceleration = Acceleration;
+
+	// The engine flies falling proxies in a straight line plus gravity, so air strafing arcs snap back on every update.
+	// Steer with the player's input the way PB air movement does, gravity is left to NewFallVelocity.
+	if (bUsePBProxyExtrapolation && IsFalling() && !HasAnimRootMotion() && !CurrentRootMotion.HasOverrideVelocity())
+	{
+		const FVector WishAccel = Acceleration.GetClampedToMaxSize2D(GetMaxSpeed());
+		Velocity = Accelerate(Velocity, WishAccel, AirSpeedCap, AirAccelerationMultiplier, DeltaTime);
+		Velocity.X = FMath::Clamp(Velocity.X, -AxisSpeedLimit, AxisSpeedLimit);
+		Velocity.Y = FMath::Clamp(Velocity.Y, -AxisSpeedLimit, AxisSpeedLimit);
+	}
+
+	Super::SimulateMovement(DeltaTime);
+	Acceleration = OriginalAcceleration;
+}
+
+void UPBPlayerMovement::SmoothCorrection(const FVector& OldLocation, const FQuat& OldRotation, const FVector& NewLocation, const FQuat& NewRotation)
+{
+	// Where we extrapolated to against where the server says we are, skipping teleports
+	if (CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		const float Error = FVector::Dist(OldLocation, NewLocation);
+		if (Error <= NetworkNoSmoothUpdateDistance)
+		{
+			ProxyExtrapolationError = FMath::Lerp(ProxyExtrapolationError, Error, 0.1f);
+			INC_DWORD_STAT(STAT_CharProxyUpdates);
+			INC_FLOAT_STAT_BY(STAT_CharProxyExtrapolationError, Error);
+		}
+	}
+
+	Super::SmoothCorrection(OldLocation, OldRotation, NewLocation, NewRotation);
+}
+
+float UPBPlayerMovement::GetCorrectionTolerance() const
+{
+	float StateScale = 1.0f;
+	if (IsOnLadder())
+	{
+		StateScale = LadderCorrectionToleranceScale;
+	}
+	else if (IsFalling())
+	{
+		StateScale = AirCorrectionToleranceScale;
+	}
+	else if (IsCrouchSliding())
+	{
+		StateScale = SlideCorrectionToleranceScale;
+	}
+	// How far we travel in the time client and server might disagree by
+	return FMath::Min(Velocity.Size() * CorrectionTimingTolerance * StateScale, MaxCorrectionTolerance);
+}
+
+bool UPBPlayerMovement::ServerExceedsAllowablePositionError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation,
+	const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	bAcceptClientPosition = false;
+	ClientPositionAcceptBudget = FMath::Min(ClientPositionAcceptBudget + DeltaTime * ClientPositionAcceptRate, MaxCorrectionTolerance);
+	if (bValidateClientMoves)
+	{
+		QueueValidationSample(ClientTimeStamp, DeltaTime, ClientWorldLocation, ClientMovementBase, ClientMovementMode);
+	}
+
+	if (!Super::ServerExceedsAllowablePositionError(ClientTimeStamp, DeltaTime, Accel, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode))
+	{
+		return false;
+	}
+
+	// A different movement mode can't be explained by timing
+	if (!bUseSpeedScaledCorrectionTolerance || PackNetworkMovementMode() != ClientMovementMode || bCheatFlying)
+	{
+		INC_DWORD_STAT(STAT_CharCorrectionsSent);
+		return true;
+	}
+
+	// Running slightly ahead of or behind the server only puts the client somewhere along our velocity
+	const FVector LocDiff = UpdatedComponent->GetComponentLocation() - ClientWorldLocation;
+	const float BaseToleranceSq = GetDefault<AGameNetworkManager>()->MAXPOSITIONERRORSQUARED;
+	const float AlongVelocity = LocDiff | Velocity.GetSafeNormal();
+	const float AcrossVelocitySq = LocDiff.SizeSquared() - FMath::Square(AlongVelocity);
+	const float Tolerance = FMath::Sqrt(BaseToleranceSq) + GetCorrectionTolerance();
+	if (AcrossVelocitySq > BaseToleranceSq || FMath::Abs(AlongVelocity) > Tolerance)
+	{
+		INC_DWORD_STAT(STAT_CharCorrectionsSent);
+		return true;
+	}
+
+	// Not worth a correction. If we have the budget, take their position so the error doesn't persist, otherwise keep ours.
+	INC_DWORD_STAT(STAT_CharCorrectionsAvoided);
+	bNetworkLargeClientCorrection = false;
+	const float Error = LocDiff.Size();
+	if (Error <= ClientPositionAcceptBudget)
+	{
+		ClientPositionAcceptBudget -= Error;
+		bAcceptClientPosition = true;
+	}
+	return false;
+}
+
+void UPBPlayerMovement::QueueValidationSample(float ClientTimeStamp, float DeltaTime, const FVector& ClientWorldLocation, UPrimitiveComponent* ClientMovementBase, uint8 ClientMovementMode)
+{
+	UPBMovementValidationSubsystem* Validation = GetWorld()->GetSubsystem<UPBMovementValidationSubsystem>();
+	if (!Validation || !PBPlayerCharacter)
+	{
+		return;
+	}
+
+	// The server's state after simulating this move, which the client should agree with
+	FPBMovementValidationSample Sample;
+	FPBMovementValidationLimits& Limits = Sample.Limits;
+	Limits.MaxSpeed = GetMaxSpeed();
+	Limits.AirSpeedCap = FMath::Max(AirSpeedCap, AirSlideSpeedCap);
+	Limits.JumpZVelocity = JumpZVelocity;
+	// Jump boost adds up to half our input acceleration, an air jump dash its magnitude of it
+	Limits.JumpSpeedAllowance = GetMaxAcceleration() * FMath::Max(0.5f, AirJumpDashMagnitude);
+	Limits.MinCrouchSlideBoost = MinCrouchSlideBoost;
+	Limits.CrouchSlideBoostMultiplier = CrouchSlideBoostMultiplier;
+	Limits.AxisSpeedLimit = AxisSpeedLimit;
+	Limits.MaxStepHeight = MaxStepHeight;
+	const float WalkableFloorZ = FMath::Max(GetWalkableFloorZ(), UE_KINDA_SMALL_NUMBER);
+	Limits.MaxWalkableRise = FMath::Sqrt(FMath::Max(1.0f - FMath::Square(WalkableFloorZ), 0.0f)) / WalkableFloorZ;
+	Limits.MaxSimulationTimeStep = MaxSimulationTimeStep;
+	Limits.SpeedTolerance = ValidationSpeedTolerance;
+	Limits.PositionTolerance = ValidationPositionTolerance;
+	Limits.SuspicionThreshold = ValidationSuspicionThreshold;
+	Limits.SuspicionDecayRate = ValidationSuspicionDecayRate;
+
+	Sample.ClientLocation = ClientWorldLocation;
+	Sample.ClientTimeStamp = ClientTimeStamp;
+	Sample.DeltaTime = DeltaTime;
+	Sample.bFalling = IsFalling();
+	Sample.bCrouchSliding = IsCrouchSliding();
+	// bPressedJump is already cleared by now, and the jump may have been in the first half of a dual move
+	Sample.bJumping = bValidationJumped;
+	// Anything that moves us other than PB movement rules, or a mode we'd correct anyway
+	Sample.bDiscontinuous = bValidationDiscontinuity || bJustTeleported || bCheatFlying || IsOnLadder() || (!IsMovingOnGround() && !IsFalling()) ||
+		PackNetworkMovementMode() != ClientMovementMode || MovementBaseUtility::UseRelativeLocation(ClientMovementBase) || HasAnimRootMotion() ||
+		CurrentRootMotion.HasActiveRootMotionSources();
+	bValidationDiscontinuity = false;
+	bValidationJumped = false;
+
+	Validation->QueueSample(this, Sample);
+}
+
+bool UPBPlayerMovement::HandlePendingLaunch()
+{
+	const bool bLaunched = Super::HandlePendingLaunch();
+	bValidationDiscontinuity |= bLaunched;
+	return bLaunched;
+}
+
+void UPBPlayerMovement::ApplyAccumulatedForces(float DeltaSeconds)
+{
+	bValidationDiscontinuity |= !PendingImpulseToApply.IsZero() || !PendingForceToApply.IsZero();
+	Super::ApplyAccumulatedForces(DeltaSeconds);
+}
+
+bool UPBPlayerMovement::ServerShouldUseAuthoritativePosition(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation,
+	const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+	if (bAcceptClientPosition)
+	{
+		bAcceptClientPosition = false;
+		INC_DWORD_STAT(STAT_CharClientPositionsAccepted);
+		return true;
+	}
+	return Super::ServerShouldUseAuthoritativePosition(ClientTimeStamp, DeltaTime, Accel, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode);
+}
+
+void UPBPlayerMovement::UpdateFromCompressedFlags(uint8 Flags)
+{
+	Super::UpdateFromCompressedFlags(Flags);
+
+	if (!PBPlayerCharacter)
+	{
+		return;
+	}
+	PBPlayerCharacter->SetSprinting((Flags & FSavedMove_PB::FLAG_Sprinting) != 0);
+	PBPlayerCharacter->SetWantsToWalk((Flags & FSavedMove_PB::FLAG_WantsToWalk) != 0);
+	bLockInCrouch = (Flags & FSavedMove_PB::FLAG_LockInCrouch) != 0;
+}
+
 void UPBPlayerMovement::ToggleCrouchLock(bool bLock)
 {
 	bLockInCrouch = bLock;
@@ -946,19 +2514,21 @@ void UPBPlayerMovement::TraceLineToFloor(FHitResult& OutHit) const
 
 void UPBPlayerMovement::PlayMoveSound(const float DeltaTime)
 {
-	if (!bShouldPlayMoveSounds)
+	if (!ShouldRunCosmetics() || !bShouldPlayMoveSounds || IsReplayingMoves() || MovementLOD != EPBMovementLOD::Full)
 	{
 		return;
 	}
 
+	SCOPE_CYCLE_COUNTER(STAT_CharCosmetics);
+
 	// Count move sound time down if we've got it
 	if (MoveSoundTime > 0.0f)
 	{
 		MoveSoundTime = FMath::Max(0.0f, MoveSoundTime - 1000.0f * DeltaTime);
 	}
 
-	// Check if it's time to play the sound
-	if (MoveSoundTime > 0.0f)
+	// Check if it's time to play the sound. If we're resting, we aren't moving fast enough to step.
+	if (MoveSoundTime > 0.0f || bIsResting)
 	{
 		return;
 	}
@@ -1087,7 +2657,7 @@ void UPBPlayerMovement::PlayMoveSound(const float DeltaTime)
 
 void UPBPlayerMovement::PlayJumpSound(const FHitResult& Hit, bool bJumped)
 {
-	if (!bShouldPlayMoveSounds)
+	if (!ShouldRunCosmetics() || !bShouldPlayMoveSounds)
 	{
 		return;
 	}
@@ -1169,6 +2739,150 @@ void UPBPlayerMovement::PlayJumpSound(const FHitResult& Hit, bool bJumped)
 	}
 }
 
+FVector UPBPlayerMovement::Accelerate(const FVector& InVelocity, const FVector& WishAccel, float SpeedCap, float AccelerationScale, float DeltaTime)
+{
+	// Find veer
+	const FVector AccelDir = WishAccel.GetSafeNormal2D();
+	const float Veer = InVelocity.X * AccelDir.X + InVelocity.Y * AccelDir.Y;
+	const float AddSpeed = WishAccel.GetClampedToMaxSize2D(SpeedCap).Size2D() - Veer;
+	if (AddSpeed <= 0.0f)
+	{
+		return InVelocity;
+	}
+	// Apply acceleration
+	FVector CurrentAcceleration = WishAccel * AccelerationScale * DeltaTime;
+	CurrentAcceleration = CurrentAcceleration.GetClampedToMaxSize2D(AddSpeed);
+	return InVelocity + CurrentAcceleration;
+}
+
+void UPBPlayerMovement::GetTrajectoryParams(FPBTrajectoryParams& OutParams, float Duration) const
+{
+	OutParams = FPBTrajectoryParams();
+	OutParams.Duration = Duration;
+	if (!HasValidData())
+	{
+		return;
+	}
+
+	OutParams.Location = UpdatedComponent->GetComponentLocation();
+	OutParams.Velocity = Velocity;
+	// Steer the way PB air movement does, see CalcVelocity
+	OutParams.WishAccel = Acceleration.GetClampedToMaxSize2D(GetMaxSpeed());
+	OutParams.GravityZ = GetGravityZ();
+	OutParams.AirSpeedCap = AirSpeedCap;
+	OutParams.AirAccelerationMultiplier = AirAccelerationMultiplier * SurfaceFriction;
+	OutParams.AxisSpeedLimit = AxisSpeedLimit;
+	OutParams.TerminalVelocity = GetPhysicsVolume()->TerminalVelocity;
+	OutParams.WalkableFloorZ = GetWalkableFloorZ();
+	OutParams.TimeStep = MaxSimulationTimeStep;
+	CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleSize(OutParams.CapsuleRadius, OutParams.CapsuleHalfHeight);
+	OutParams.CollisionChannel = UpdatedComponent->GetCollisionObjectType();
+	OutParams.IgnoredActor = CharacterOwner;
+}
+
+void UPBPlayerMovement::PredictTrajectory(float Duration, FPBTrajectoryResult& OutResult) const
+{
+	FPBTrajectoryParams Params;
+	GetTrajectoryParams(Params, Duration);
+	FPBTrajectoryPrediction::Predict(GetWorld(), Params, OutResult);
+}
+
+void UPBPlayerMovement::RecordInputSimLatency()
+{
+	// Without saved moves, take the input straight from the character
+	if (MoveInputTime <= 0.0 && PBPlayerCharacter)
+	{
+		MoveInputTime = PBPlayerCharacter->ConsumeInputLatencyTag();
+	}
+	if (MoveInputTime <= 0.0)
+	{
+		return;
+	}
+
+	InputToSimLatency = (FPlatformTime::Seconds() - MoveInputTime) * 1000.0;
+	SET_FLOAT_STAT(STAT_CharInputToSim, InputToSimLatency);
+	CSV_CUSTOM_STAT(PBMovement, InputToSimMs, InputToSimLatency, ECsvCustomStatOp::Set);
+
+	// The server is us, so it applies and acknowledges the input right away
+	if (CharacterOwner->HasAuthority())
+	{
+		RecordInputAckLatency(MoveInputTime, FPlatformTime::Seconds());
+	}
+	MoveInputTime = 0.0;
+}
+
+void UPBPlayerMovement::MarkMovesSent(const FSavedMove_Character* NewMove, const FSavedMove_Character* PendingMove)
+{
+	// Resent old moves keep their first send time
+	const double Now = FPlatformTime::Seconds();
+	for (const FSavedMove_Character* Move : {NewMove, PendingMove})
+	{
+		const FSavedMove_PB* PBMove = static_cast<const FSavedMove_PB*>(Move);
+		if (PBMove && PBMove->SavedSendTime <= 0.0)
+		{
+			PBMove->SavedSendTime = Now;
+		}
+	}
+}
+
+void UPBPlayerMovement::CallServerMovePacked(const FSavedMove_Character* NewMove, const FSavedMove_Character* PendingMove, const FSavedMove_Character* OldMove)
+{
+	MarkMovesSent(NewMove, PendingMove);
+	Super::CallServerMovePacked(NewMove, PendingMove, OldMove);
+}
+
+void UPBPlayerMovement::CallServerMove(const FSavedMove_Character* NewMove, const FSavedMove_Character* OldMove)
+{
+	// A pending move goes out now too, as the first half of a dual move
+	const FNetworkPredictionData_Client_Character* ClientData = GetPredictionData_Client_Character();
+	MarkMovesSent(NewMove, ClientData ? ClientData->PendingMove.Get() : nullptr);
+	Super::CallServerMove(NewMove, OldMove);
+}
+
+void UPBPlayerMovement::ClientAckGoodMove_Implementation(float TimeStamp)
+{
+	RecordAckedMovesLatency(TimeStamp);
+	Super::ClientAckGoodMove_Implementation(TimeStamp);
+}
+
+void UPBPlayerMovement::ClientAdjustPosition_Implementation(float TimeStamp, FVector NewLoc, FVector NewVel, UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase,
+	bool bBaseRelativePosition, uint8 ServerMovementMode, TOptional<FRotator> OptionalRotation)
+{
+	RecordAckedMovesLatency(TimeStamp);
+	Super::ClientAdjustPosition_Implementation(TimeStamp, NewLoc, NewVel, NewBase, NewBaseBoneName, bHasBase, bBaseRelativePosition, ServerMovementMode, OptionalRotation);
+}
+
+void UPBPlayerMovement::RecordAckedMovesLatency(float TimeStamp)
+{
+	if (!HasValidData() || !CharacterOwner->IsLocallyControlled())
+	{
+		return;
+	}
+	const FNetworkPredictionData_Client_Character* ClientData = GetPredictionData_Client_Character();
+	const int32 AckedMoveIndex = ClientData ? ClientData->GetSavedMoveIndex(TimeStamp) : INDEX_NONE;
+	// Every move up to the acked one is acknowledged with it
+	for (int32 MoveIndex = 0; MoveIndex <= AckedMoveIndex; MoveIndex++)
+	{
+		const FSavedMove_PB* Move = static_cast<const FSavedMove_PB*>(ClientData->SavedMoves[MoveIndex].Get());
+		if (Move->SavedInputTime > 0.0 && Move->SavedSendTime > 0.0)
+		{
+			RecordInputAckLatency(Move->SavedInputTime, Move->SavedSendTime);
+		}
+	}
+}
+
+void UPBPlayerMovement::RecordInputAckLatency(double InputTime, double SendTime)
+{
+	const double Now = FPlatformTime::Seconds();
+	InputToAckLatency = (Now - InputTime) * 1000.0;
+	// We can't read the server's clock, so assume the move spent half its round trip getting there
+	InputToServerLatency = ((SendTime - InputTime) + (Now - SendTime) * 0.5) * 1000.0;
+	SET_FLOAT_STAT(STAT_CharInputToServer, InputToServerLatency);
+	SET_FLOAT_STAT(STAT_CharInputToAck, InputToAckLatency);
+	CSV_CUSTOM_STAT(PBMovement, InputToServerMs, InputToServerLatency, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PBMovement, InputToAckMs, InputToAckLatency, ECsvCustomStatOp::Set);
+}
+
 void UPBPlayerMovement::CalcVelocity(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration)
 {
 	// UE4-COPY: void UCharacterMovementComponent::CalcVelocity(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration)
@@ -1179,6 +2893,12 @@ void UPBPlayerMovement::CalcVelocity(float DeltaTime, float Friction, bool bFlui
 		return;
 	}
 
+	// Replays already measured their moves the first time round
+	if (!IsReplayingMoves() && CharacterOwner->IsLocallyControlled())
+	{
+		RecordInputSimLatency();
+	}
+
 	Friction = FMath::Max(0.0f, Friction);
 	const float MaxAccel = GetMaxAcceleration();
 	float MaxSpeed = GetMaxSpeed();
@@ -1233,7 +2953,8 @@ void UPBPlayerMovement::CalcVelocity(float DeltaTime, float Friction, bool bFlui
 
 		float ActualBrakingFriction = (bUseSeparateBrakingFriction ? BrakingFriction : Friction) * SurfaceFriction;
 
-		if (bIsGroundMove && EdgeFrictionMultiplier != 1.0f)
+		// Edge friction's floor trace is skipped for AI no player is close to
+		if (bIsGroundMove && EdgeFrictionMultiplier != 1.0f && MovementLOD == EPBMovementLOD::Full)
 		{
 			bool bDoEdgeFriction = false;
 			if (!bEdgeFrictionOnlyWhenBraking)
@@ -1319,10 +3040,8 @@ void UPBPlayerMovement::CalcVelocity(float DeltaTime, float Friction, bool bFlui
 		const FVector FloorNormal = CurrentFloor.HitResult.ImpactNormal;
 		// Direction of our crouch slide
 		const FVector CrouchSlideInput = GetOwner()->GetActorForwardVector();
-		float CurrentTime = GetWorld()->GetTimeSeconds();
-		float TimeDifference = CurrentTime - CrouchSlideStartTime;
 		// Decay velocity boosting within acceleration over time
-		FVector WishAccel = CrouchSlideInput * Velocity.Size2D() * FMath::Lerp(MaxCrouchSlideVelocityBoost, MinCrouchSlideVelocityBoost, FMath::Clamp(TimeDifference / CrouchSlideBoostTime, 0.0f, 1.0f));
+		FVector WishAccel = CrouchSlideInput * Velocity.Size2D() * FMath::Lerp(MaxCrouchSlideVelocityBoost, MinCrouchSlideVelocityBoost, FMath::Clamp(CrouchSlideElapsedTime / CrouchSlideBoostTime, 0.0f, 1.0f));
 		float Slope = (CrouchSlideInput | FloorNormal);
 		// Handle slope (decay more on uphill, boost on downhill)
 		WishAccel *= 1.0f + Slope;
@@ -1345,16 +3064,14 @@ void UPBPlayerMovement::CalcVelocity(float DeltaTime, float Friction, bool bFlui
 		{
 			// Clamp acceleration to max speed
 			const FVector WishAccel = Acceleration.GetClampedToMaxSize2D(MaxSpeed);
-			// Find veer
-			const FVector AccelDir = WishAccel.GetSafeNormal2D();
-			const float Veer = Velocity.X * AccelDir.X + Velocity.Y * AccelDir.Y;
 			// Get add speed with an air speed cap, depending on if we're sliding in air or not
 			// note: we use b WAS SlidingInAir since we only can categorize our movement after a velocity step, therefore we have to use the slide state from the previous frame while computing velocity
-			float SpeedCap = 0.0f;
+			// on the ground the wish accel is already clamped to max speed
+			float SpeedCap = MaxSpeed;
 			if (!bIsGroundMove)
 			{
 				// use original air speed cap for strafing during a slide, for surfing
-				float ForwardAccel = AccelDir | GetOwner()->GetActorForwardVector();
+				float ForwardAccel = WishAccel.GetSafeNormal2D() | GetOwner()->GetActorForwardVector();
 				if (bWasSlidingInAir && FMath::IsNearlyZero(ForwardAccel))
 				{
 					SpeedCap = AirSlideSpeedCap;
@@ -1364,15 +3081,8 @@ void UPBPlayerMovement::CalcVelocity(float DeltaTime, float Friction, bool bFlui
 					SpeedCap = AirSpeedCap;
 				}
 			}
-			const float AddSpeed = (bIsGroundMove ? WishAccel : WishAccel.GetClampedToMaxSize2D(SpeedCap)).Size2D() - Veer;
-			if (AddSpeed > 0.0f)
-			{
-				// Apply acceleration
-				const float AccelerationMultiplier = bIsGroundMove ? GroundAccelerationMultiplier : AirAccelerationMultiplier;
-				FVector CurrentAcceleration = WishAccel * AccelerationMultiplier * SurfaceFriction * DeltaTime;
-				CurrentAcceleration = CurrentAcceleration.GetClampedToMaxSize2D(AddSpeed);
-				Velocity += CurrentAcceleration;
-			}
+			const float AccelerationMultiplier = bIsGroundMove ? GroundAccelerationMultiplier : AirAccelerationMultiplier;
+			Velocity = Accelerate(Velocity, WishAccel, SpeedCap, AccelerationMultiplier * SurfaceFriction, DeltaTime);
 		}
 
 		// No requested accel on player
@@ -1432,9 +3142,14 @@ void UPBPlayerMovement::CalcVelocity(float DeltaTime, float Friction, bool bFlui
 
 void UPBPlayerMovement::Crouch(bool bClientSimulation)
 {
-	// TODO: replicate to the client simulation that we are in a crouch transition so they can do the resize too.
 	if (bClientSimulation)
 	{
+		if (CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy)
+		{
+			// The transition itself comes from the replicated crouch alpha
+			SetProxyCapsuleCrouched(true);
+			return;
+		}
 		Super::Crouch(true);
 		return;
 	}
@@ -1470,9 +3185,12 @@ void UPBPlayerMovement::DoCrouchResize(float TargetTime, float DeltaTime, bool b
 		return;
 	}
 
+	// Pick up where we are, in case something else resized the capsule
+	CrouchAlpha = GetCrouchAlpha();
+
 	// See if collision is already at desired size.
 	UCapsuleComponent* CharacterCapsule = CharacterOwner->GetCapsuleComponent();
-	if (FMath::IsNearlyEqual(CharacterCapsule->GetUnscaledCapsuleHalfHeight(), GetCrouchedHalfHeight()))
+	if (FMath::IsNearlyEqual(CharacterCapsule->GetUnscaledCapsuleHalfHeight(), GetCrouchedHalfHeight()) && CrouchAlpha >= 1.0f)
 	{
 		if (!bClientSimulation)
 		{
@@ -1502,20 +3220,26 @@ void UPBPlayerMovement::DoCrouchResize(float TargetTime, float DeltaTime, bool b
 	const bool bInstantCrouch = FMath::IsNearlyZero(TargetTime);
 	const float CurrentAlpha = 1.0f - (CurrentUnscaledHalfHeight - GetCrouchedHalfHeight()) / FullCrouchDiff;
 	// Determine how much we are progressing this tick
-	float TargetAlphaDiff = 1.0f;
 	float TargetAlpha = 1.0f;
 	if (!bInstantCrouch)
 	{
-		TargetAlphaDiff = DeltaTime / CrouchTime;
-		TargetAlpha = CurrentAlpha + TargetAlphaDiff;
+		TargetAlpha = CrouchAlpha + DeltaTime / CrouchTime;
 	}
 	if (TargetAlpha >= 1.0f || FMath::IsNearlyEqual(TargetAlpha, 1.0f))
 	{
 		TargetAlpha = 1.0f;
-		TargetAlphaDiff = TargetAlpha - CurrentAlpha;
 		bIsInCrouchTransition = false;
 		CharacterOwner->bIsCrouched = true;
 	}
+	CrouchAlpha = TargetAlpha;
+	// The capsule only resizes when we cross a step, otherwise just move the eyes
+	TargetAlpha = QuantizeCrouchAlpha(TargetAlpha);
+	const float TargetAlphaDiff = TargetAlpha - CurrentAlpha;
+	if (FMath::IsNearlyZero(TargetAlphaDiff))
+	{
+		CharacterOwner->RecalculateBaseEyeHeight();
+		return;
+	}
 	// Determine the target height for this tick
 	float TargetCrouchedHalfHeight = OldUnscaledHalfHeight - FullCrouchDiff * TargetAlpha;
 	// Height is not allowed to be smaller than radius.
@@ -1559,9 +3283,14 @@ void UPBPlayerMovement::DoCrouchResize(float TargetTime, float DeltaTime, bool b
 
 void UPBPlayerMovement::UnCrouch(bool bClientSimulation)
 {
-	// TODO: replicate to the client simulation that we are in a crouch transition so they can do the resize too.
 	if (bClientSimulation)
 	{
+		if (CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy)
+		{
+			// The transition itself comes from the replicated crouch alpha
+			SetProxyCapsuleCrouched(false);
+			return;
+		}
 		Super::UnCrouch(true);
 		return;
 	}
@@ -1569,6 +3298,41 @@ void UPBPlayerMovement::UnCrouch(bool bClientSimulation)
 	StopCrouchSliding();
 }
 
+void UPBPlayerMovement::SetProxyCapsuleCrouched(bool bCrouched)
+{
+	if (!HasValidData())
+	{
+		return;
+	}
+
+	const ACharacter* DefaultCharacter = CharacterOwner->GetClass()->GetDefaultObject<ACharacter>();
+	const float DefaultHalfHeight = DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
+	const float TargetHalfHeight = bCrouched ? GetCrouchedHalfHeight() : DefaultHalfHeight;
+	UCapsuleComponent* CharacterCapsule = CharacterOwner->GetCapsuleComponent();
+	const float ComponentScale = CharacterCapsule->GetShapeScale();
+
+	// Restore the real collision size before changing it, the proxy capsule may have been shrunk
+	CharacterCapsule->SetCapsuleSize(DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleRadius(), TargetHalfHeight);
+	bShrinkProxyCapsule = true;
+	AdjustProxyCapsuleSize();
+	bForceNextFloorCheck = true;
+
+	// Let blueprints know, then put the mesh back where the replicated crouch alpha wants it. Our location doesn't jump, so there is nothing to smooth.
+	const float MeshAdjust = DefaultHalfHeight - GetCrouchedHalfHeight();
+	if (bCrouched)
+	{
+		CharacterOwner->OnStartCrouch(MeshAdjust, MeshAdjust * ComponentScale);
+	}
+	else
+	{
+		CharacterOwner->OnEndCrouch(MeshAdjust, MeshAdjust * ComponentScale);
+	}
+	if (PBPlayerCharacter)
+	{
+		PBPlayerCharacter->ApplyProxyCrouchAlpha();
+	}
+}
+
 void UPBPlayerMovement::DoUnCrouchResize(float TargetTime, float DeltaTime, bool bClientSimulation)
 {
 	// UE4-COPY: void UCharacterMovementComponent::UnCrouch(bool bClientSimulation)
@@ -1583,9 +3347,13 @@ void UPBPlayerMovement::DoUnCrouchResize(float TargetTime, float DeltaTime, bool
 
 	UCapsuleComponent* CharacterCapsule = CharacterOwner->GetCapsuleComponent();
 
+	// Pick up where we are, in case something else resized the capsule
+	CrouchAlpha = GetCrouchAlpha();
+
 	// See if collision is already at desired size.
 	if (FMath::IsNearlyEqual(CharacterCapsule->GetUnscaledCapsuleHalfHeight(), DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight()))
 	{
+		CrouchAlpha = 0.0f;
 		if (!bClientSimulation)
 		{
 			CharacterOwner->bIsCrouched = false;
@@ -1604,6 +3372,7 @@ void UPBPlayerMovement::DoUnCrouchResize(float TargetTime, float DeltaTime, bool
 	const float FullCrouchDiff = UncrouchedHeight - GetCrouchedHalfHeight();
 	// Determine the crouching progress
 	const bool bInstantCrouch = FMath::IsNearlyZero(TargetTime);
+	// Uncrouch progress, the opposite of CrouchAlpha
 	float CurrentAlpha = 1.0f - (UncrouchedHeight - OldUnscaledHalfHeight) / FullCrouchDiff;
 	float TargetAlphaDiff = 1.0f;
 	float TargetAlpha = 1.0f;
@@ -1611,8 +3380,7 @@ void UPBPlayerMovement::DoUnCrouchResize(float TargetTime, float DeltaTime, bool
 	const FVector PawnLocation = UpdatedComponent->GetComponentLocation();
 	if (!bInstantCrouch)
 	{
-		TargetAlphaDiff = DeltaTime / TargetTime;
-		TargetAlpha = CurrentAlpha + TargetAlphaDiff;
+		TargetAlpha = 1.0f - CrouchAlpha + DeltaTime / TargetTime;
 		// Don't partial uncrouch in tight places (like vents)
 		if (bCrouchMaintainsBaseLocation)
 		{
@@ -1642,10 +3410,19 @@ void UPBPlayerMovement::DoUnCrouchResize(float TargetTime, float DeltaTime, bool
 	if (TargetAlpha >= 1.0f || FMath::IsNearlyEqual(TargetAlpha, 1.0f))
 	{
 		TargetAlpha = 1.0f;
-		TargetAlphaDiff = TargetAlpha - CurrentAlpha;
 		bIsInCrouchTransition = false;
 		StopCrouchSliding();
 	}
+	// The capsule only grows when we cross a step, otherwise just move the eyes
+	const float SmoothCrouchAlpha = 1.0f - TargetAlpha;
+	TargetAlpha = 1.0f - QuantizeCrouchAlpha(SmoothCrouchAlpha);
+	TargetAlphaDiff = TargetAlpha - CurrentAlpha;
+	if (FMath::IsNearlyZero(TargetAlphaDiff))
+	{
+		CrouchAlpha = SmoothCrouchAlpha;
+		CharacterOwner->RecalculateBaseEyeHeight();
+		return;
+	}
 	const float HalfHeightAdjust = FullCrouchDiff * TargetAlphaDiff;
 	const float ScaledHalfHeightAdjust = HalfHeightAdjust * ComponentScale;
 
@@ -1753,6 +3530,7 @@ void UPBPlayerMovement::DoUnCrouchResize(float TargetTime, float DeltaTime, bool
 	{
 		bShrinkProxyCapsule = true;
 	}
+	CrouchAlpha = SmoothCrouchAlpha;
 
 	// Now call SetCapsuleSize() to cause touch/untouch events and actually grow the capsule
 	CharacterCapsule->SetCapsuleSize(DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleRadius(), OldUnscaledHalfHeight + HalfHeightAdjust, true);
@@ -1775,8 +3553,64 @@ void UPBPlayerMovement::DoUnCrouchResize(float TargetTime, float DeltaTime, bool
 	}
 }
 
+float UPBPlayerMovement::QuantizeCrouchAlpha(float Alpha) const
+{
+	if (CrouchCapsuleSteps <= 0)
+	{
+		return Alpha;
+	}
+	// Round towards crouched, so the capsule is never taller than the smooth crouch and shrinking never needs a blocking test
+	return FMath::Clamp(FMath::CeilToFloat(Alpha * CrouchCapsuleSteps - UE_KINDA_SMALL_NUMBER) / CrouchCapsuleSteps, 0.0f, 1.0f);
+}
+
+float UPBPlayerMovement::GetCrouchAlpha() const
+{
+	// Fall back to the capsule if it was resized without us, e.g. by client simulation
+	const float CapsuleAlpha = GetCapsuleCrouchAlpha();
+	return FMath::IsNearlyEqual(QuantizeCrouchAlpha(CrouchAlpha), CapsuleAlpha, 1e-3f) ? CrouchAlpha : CapsuleAlpha;
+}
+
+float UPBPlayerMovement::GetCapsuleCrouchAlpha() const
+{
+	if (!HasValidData())
+	{
+		return 0.0f;
+	}
+	const ACharacter* DefaultCharacter = CharacterOwner->GetClass()->GetDefaultObject<ACharacter>();
+	const float UncrouchedHalfHeight = DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
+	const float FullCrouchDiff = UncrouchedHalfHeight - GetCrouchedHalfHeight();
+	if (FullCrouchDiff <= UE_KINDA_SMALL_NUMBER)
+	{
+		return CharacterOwner->bIsCrouched ? 1.0f : 0.0f;
+	}
+	return FMath::Clamp((UncrouchedHalfHeight - CharacterOwner->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight()) / FullCrouchDiff, 0.0f, 1.0f);
+}
+
+float UPBPlayerMovement::GetCrouchEyeHeightOffset() const
+{
+	if (!HasValidData())
+	{
+		return 0.0f;
+	}
+	const ACharacter* DefaultCharacter = CharacterOwner->GetClass()->GetDefaultObject<ACharacter>();
+	const UCapsuleComponent* CharacterCapsule = CharacterOwner->GetCapsuleComponent();
+	const float FullCrouchDiff = DefaultCharacter->GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight() - GetCrouchedHalfHeight();
+	// How much taller the smooth capsule would be than the real one
+	const float HalfHeightDiff = (GetCapsuleCrouchAlpha() - GetCrouchAlpha()) * FullCrouchDiff * CharacterCapsule->GetShapeScale();
+	// With the base fixed the real capsule center is lower than it would be, otherwise the top is fixed and the center is higher
+	return bCrouchMaintainsBaseLocation ? HalfHeightDiff : -HalfHeightDiff;
+}
+
+bool UPBPlayerMovement::FloorSweepTest(FHitResult& OutHit, const FVector& Start, const FVector& End, ECollisionChannel TraceChannel, const FCollisionShape& CollisionShape,
+	const FCollisionQueryParams& Params, const FCollisionResponseParams& ResponseParam) const
+{
+	StepUpSweepCount += bCountingStepUpSweeps;
+	return Super::FloorSweepTest(OutHit, Start, End, TraceChannel, CollisionShape, Params, ResponseParam);
+}
+
 bool UPBPlayerMovement::MoveUpdatedComponentImpl(const FVector& Delta, const FQuat& NewRotation, bool bSweep, FHitResult* OutHit, ETeleportType Teleport)
 {
+	StepUpSweepCount += bCountingStepUpSweeps && bSweep;
 	FVector NewDelta = Delta;
 
 	// Start from the capsule location pre-move
@@ -0,0 +1,136 @@
+// Copyright Project Borealis
+
+#include "Character/PBTrajectoryPrediction.h"
+
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+
+#include "Character/PBPlayerMovement.h"
+
+DECLARE_CYCLE_STAT(TEXT("Char Trajectory Prediction"), STAT_CharTrajectoryPrediction, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Trajectory Predictions"), STAT_CharTrajectoryPredictions, STATGROUP_Character);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Char Trajectory Sweeps"), STAT_CharTrajectorySweeps, STATGROUP_Character);
+
+// Smallest step worth integrating, so float error doesn't spin the loop
+constexpr float MIN_TRAJECTORY_STEP = 1e-4f;
+// Fewest batch items per worker, a prediction without steering is too cheap to hand out one at a time
+constexpr int32 MIN_TRAJECTORY_BATCH_SIZE = 16;
+
+/**
+ * Fall for DeltaTime at constant gravity, clamping fall speed like NewFallVelocity.
+ * Exact for the whole step, including reaching the speed limit partway through it.
+ * @return Z distance travelled
+ */
+static float IntegrateFall(float& VelocityZ, float GravityZ, float SpeedLimit, float DeltaTime)
+{
+	const float StartVelocity = FMath::Clamp(VelocityZ, -SpeedLimit, SpeedLimit);
+	const float EndVelocity = StartVelocity + GravityZ * DeltaTime;
+	if (FMath::Abs(EndVelocity) <= SpeedLimit || GravityZ == 0.0f)
+	{
+		VelocityZ = FMath::Clamp(EndVelocity, -SpeedLimit, SpeedLimit);
+		return 0.5f * (StartVelocity + EndVelocity) * DeltaTime;
+	}
+
+	// Accelerate up to the limit, then hold it
+	const float LimitVelocity = EndVelocity > 0.0f ? SpeedLimit : -SpeedLimit;
+	const float TimeToLimit = FMath::Clamp((LimitVelocity - StartVelocity) / GravityZ, 0.0f, DeltaTime);
+	VelocityZ = LimitVelocity;
+	return 0.5f * (StartVelocity + LimitVelocity) * TimeToLimit + LimitVelocity * (DeltaTime - TimeToLimit);
+}
+
+void FPBTrajectoryPrediction::Predict(const UWorld* World, const FPBTrajectoryParams& Params, FPBTrajectoryResult& OutResult, TArray<FVector>* OutPath)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CharTrajectoryPrediction);
+	INC_DWORD_STAT(STAT_CharTrajectoryPredictions);
+
+	const float FallSpeedLimit = Params.TerminalVelocity > 0.0f ? FMath::Min(Params.AxisSpeedLimit, Params.TerminalVelocity) : Params.AxisSpeedLimit;
+	const float SweepInterval = FMath::Max(Params.SweepInterval, MIN_TRAJECTORY_STEP);
+	// Without steering nothing changes between sweeps that the fall integration doesn't already get exactly
+	const bool bSteering = !Params.WishAccel.IsNearlyZero();
+	const float TimeStep = bSteering ? FMath::Clamp(Params.TimeStep, MIN_TRAJECTORY_STEP, SweepInterval) : SweepInterval;
+	const FVector WishAccel = Params.WishAccel;
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(PBTrajectorySweep), false, Params.IgnoredActor);
+	const FCollisionShape Capsule = FCollisionShape::MakeCapsule(Params.CapsuleRadius, Params.CapsuleHalfHeight);
+
+	FVector Location = Params.Location;
+	FVector Velocity = Params.Velocity;
+	FVector SweepStart = Location;
+	float SweepStartTime = 0.0f;
+	float NextSweepTime = FMath::Min(SweepInterval, Params.Duration);
+	float Time = 0.0f;
+
+	OutResult = FPBTrajectoryResult();
+	if (OutPath)
+	{
+		OutPath->Add(Location);
+	}
+
+	while (Time < Params.Duration - MIN_TRAJECTORY_STEP)
+	{
+		const float DeltaTime = FMath::Min(TimeStep, NextSweepTime - Time);
+		if (bSteering)
+		{
+			Velocity = UPBPlayerMovement::Accelerate(Velocity, WishAccel, Params.AirSpeedCap, Params.AirAccelerationMultiplier, DeltaTime);
+			Velocity.X = FMath::Clamp(Velocity.X, -Params.AxisSpeedLimit, Params.AxisSpeedLimit);
+			Velocity.Y = FMath::Clamp(Velocity.Y, -Params.AxisSpeedLimit, Params.AxisSpeedLimit);
+		}
+		Location.X += Velocity.X * DeltaTime;
+		Location.Y += Velocity.Y * DeltaTime;
+		Location.Z += IntegrateFall(Velocity.Z, Params.GravityZ, FallSpeedLimit, DeltaTime);
+		Time += DeltaTime;
+
+		if (Time < NextSweepTime - MIN_TRAJECTORY_STEP)
+		{
+			continue;
+		}
+
+		FHitResult Hit;
+		if (World)
+		{
+			INC_DWORD_STAT(STAT_CharTrajectorySweeps);
+			World->SweepSingleByChannel(Hit, SweepStart, Location, FQuat::Identity, Params.CollisionChannel, Capsule, QueryParams);
+		}
+		// Starting inside something says nothing about where we're going
+		if (Hit.bBlockingHit && !Hit.bStartPenetrating)
+		{
+			Location = Hit.Location;
+			Time = FMath::Lerp(SweepStartTime, Time, Hit.Time);
+			OutResult.bHit = true;
+			OutResult.bLanded = Hit.ImpactNormal.Z >= Params.WalkableFloorZ;
+			OutResult.HitNormal = Hit.ImpactNormal;
+			if (OutPath)
+			{
+				OutPath->Add(Location);
+			}
+			break;
+		}
+
+		if (OutPath)
+		{
+			OutPath->Add(Location);
+		}
+		SweepStart = Location;
+		SweepStartTime = Time;
+		NextSweepTime = FMath::Min(NextSweepTime + SweepInterval, Params.Duration);
+	}
+
+	OutResult.Location = Location;
+	OutResult.Velocity = Velocity;
+	OutResult.Time = Time;
+}
+
+void FPBTrajectoryPrediction::PredictBatch(const UWorld* World, TConstArrayView<FPBTrajectoryParams> Params, TArrayView<FPBTrajectoryResult> OutResults)
+{
+	check(OutResults.Num() >= Params.Num());
+	const int32 NumBatches = FMath::Max(Params.Num() / MIN_TRAJECTORY_BATCH_SIZE, 1);
+	ParallelFor(NumBatches, [&](int32 BatchIndex)
+	{
+		const int32 Start = BatchIndex * Params.Num() / NumBatches;
+		const int32 End = (BatchIndex + 1) * Params.Num() / NumBatches;
+		for (int32 Index = Start; Index < End; Index++)
+		{
+			Predict(World, Params[Index], OutResults[Index]);
+		}
+	});
+}
@@ -0,0 +1,86 @@
+// Copyright Project Borealis
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Components/CapsuleComponent.h"
+
+#include "PBMovementTestWorld.h"
+
+namespace PBClipPlanesTest
+{
+	/** How far a clipped move may still go into a plane, for float error */
+	constexpr float PlaneTolerance = 1e-4f;
+	/** How far into a wall the capsule may end up, for sweep skin and float error */
+	constexpr float WallTolerance = 1.0f;
+	/** How close to the corner we must get, to know we slid into it rather than stopping at the first wall */
+	constexpr float CornerReach = 5.0f;
+} // namespace PBClipPlanesTest
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPBClipPlanesCreaseTest, "PBCharacterMovement.ClipPlanes.Crease", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FPBClipPlanesCreaseTest::RunTest(const FString& Parameters)
+{
+	using namespace PBClipPlanesTest;
+
+	// Down into the valley between two surf ramps, each of which alone would push us up the other
+	const FVector Planes[] = {FVector(0.0f, 0.6f, 0.8f), FVector(0.0f, -0.6f, 0.8f)};
+	const FVector Move(1.0f, 0.0f, -1.0f);
+	const FVector Clipped = UPBPlayerMovement::ClipToPlanes(Move, Planes, 2, Move, 1.0f);
+
+	TestTrue(TEXT("Clipped move doesn't go into the first plane"), (Clipped | Planes[0]) >= -PlaneTolerance);
+	TestTrue(TEXT("Clipped move doesn't go into the second plane"), (Clipped | Planes[1]) >= -PlaneTolerance);
+	TestTrue(TEXT("Clipped move runs along the crease"), Clipped.GetSafeNormal().Equals(FVector(1.0f, 0.0f, 0.0f), PlaneTolerance));
+	TestTrue(TEXT("Clipped move keeps going the way we were"), (Clipped | Move) > 0.0f);
+
+	// A single plane overbounces off it
+	const FVector Bounced = UPBPlayerMovement::ClipToPlanes(Move, Planes, 1, Move, 1.5f);
+	TestTrue(TEXT("Overbounce pushes away from a single plane"), (Bounced | Planes[0]) > PlaneTolerance);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPBClipPlanesCornerTest, "PBCharacterMovement.ClipPlanes.Corner", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FPBClipPlanesCornerTest::RunTest(const FString& Parameters)
+{
+	using namespace PBClipPlanesTest;
+
+	// Two walls and the floor, every single and paired clip still goes into one of them
+	const FVector Planes[] = {FVector(-1.0f, 0.0f, 0.0f), FVector(0.0f, -1.0f, 0.0f), FVector(0.0f, 0.0f, 1.0f)};
+	const FVector Move(1.0f, 1.0f, -1.0f);
+	TestTrue(TEXT("A three plane corner stops the move dead"), UPBPlayerMovement::ClipToPlanes(Move, Planes, 3, Move, 1.0f).IsNearlyZero());
+
+	// Now walk into one, walls facing -X and -Y with their faces at 200
+	constexpr float WallFace = 200.0f;
+	FPBMovementTestWorld TestWorld;
+	TestWorld.SpawnFloor();
+	TestWorld.SpawnBox(FVector(WallFace + 50.0f, 0.0f, 100.0f), FVector(100.0f, 1000.0f, 200.0f));
+	TestWorld.SpawnBox(FVector(0.0f, WallFace + 50.0f, 100.0f), FVector(1000.0f, 100.0f, 200.0f));
+	APBPlayerCharacter* Character = TestWorld.SpawnCharacter(FVector(0.0f, 0.0f, 100.0f));
+	if (!TestNotNull(TEXT("Spawned a PB character"), Character))
+	{
+		return true;
+	}
+
+	Character->GetMovementPtr()->bUseMultiPlaneClipping = true;
+	// Mostly into the X wall, so we have to slide along it to reach the corner
+	const FVector Input = FVector(1.0f, 0.3f, 0.0f).GetSafeNormal();
+	for (int32 Frame = 0; Frame < 180; Frame++)
+	{
+		Character->AddMovementInput(Input);
+		FPBMovementTestWorld::TickCharacter(Character);
+	}
+
+	const FVector Location = Character->GetActorLocation();
+	const float Limit = WallFace - Character->GetCapsuleComponent()->GetScaledCapsuleRadius();
+	TestTrue(TEXT("Didn't go through the X wall"), Location.X <= Limit + WallTolerance);
+	TestTrue(TEXT("Didn't go through the Y wall"), Location.Y <= Limit + WallTolerance);
+	TestTrue(TEXT("Slid along the X wall into the corner"), Location.X >= Limit - CornerReach && Location.Y >= Limit - CornerReach);
+	TestTrue(TEXT("Stayed on the floor"), Character->GetCharacterMovement()->IsMovingOnGround());
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
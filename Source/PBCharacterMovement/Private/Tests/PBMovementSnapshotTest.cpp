@@ -0,0 +1,108 @@
+// Copyright Project Borealis
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Character/PBMovementSnapshot.h"
+#include "PBMovementTestWorld.h"
+
+namespace PBMovementSnapshotTest
+{
+	/** Each cycle moves, then stands still long enough to stop and come to rest */
+	constexpr int32 CycleFrames = 200;
+	constexpr int32 MovingFrames = 80;
+	constexpr int32 MovingStartFrame = 30;
+	/** Late in the first idle stretch, well after we've come to rest */
+	constexpr int32 RestingStartFrame = 190;
+	/** Over a cycle, so the first run comes to rest again somewhere else */
+	constexpr int32 ResimulatedFrames = 240;
+
+	/** Input for a frame depends only on the frame, so both runs get exactly the same. Covers running, jumps, crouch slides, air strafing and resting. */
+	void StepFrame(APBPlayerCharacter* Character, int32 Frame)
+	{
+		const int32 CycleFrame = Frame % CycleFrames;
+		if (CycleFrame < MovingFrames)
+		{
+			const float Yaw = Frame * 1.5f;
+			Character->AddMovementInput(FRotator(0.0f, Yaw, 0.0f).Vector());
+		}
+		Character->SetSprinting(CycleFrame < MovingFrames / 2);
+		if (CycleFrame == 10 || CycleFrame == 60)
+		{
+			Character->Jump();
+		}
+		else if (CycleFrame == 20 || CycleFrame == 70)
+		{
+			Character->StopJumping();
+		}
+		if (CycleFrame == 35)
+		{
+			Character->Crouch();
+		}
+		else if (CycleFrame == 55)
+		{
+			Character->UnCrouch();
+		}
+		FPBMovementTestWorld::TickCharacter(Character);
+	}
+
+	FPBMovementSnapshot Simulate(UPBPlayerMovement* Movement, APBPlayerCharacter* Character, int32 FirstFrame, int32 NumFrames)
+	{
+		for (int32 Frame = FirstFrame; Frame < FirstFrame + NumFrames; Frame++)
+		{
+			StepFrame(Character, Frame);
+		}
+		FPBMovementSnapshot Snapshot;
+		Movement->CaptureSnapshot(Snapshot);
+		return Snapshot;
+	}
+} // namespace PBMovementSnapshotTest
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPBMovementSnapshotDeterminismTest, "PBCharacterMovement.Snapshot.Determinism", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FPBMovementSnapshotDeterminismTest::RunTest(const FString& Parameters)
+{
+	using namespace PBMovementSnapshotTest;
+
+	FPBMovementTestWorld TestWorld;
+	TestWorld.SpawnFloor();
+	APBPlayerCharacter* Character = TestWorld.SpawnCharacter(FVector(0.0f, 0.0f, 200.0f));
+	UPBPlayerMovement* Movement = Character ? Character->GetMovementPtr() : nullptr;
+	if (TestNotNull(TEXT("Spawned a PB character"), Movement))
+	{
+		// Snapshot at StartFrame, run on, then rewind and run the same frames again
+		auto TestResimulation = [this, Movement, Character](const TCHAR* What, int32 StartFrame)
+		{
+			FPBMovementSnapshot Start;
+			Movement->CaptureSnapshot(Start);
+			const FPBMovementSnapshot FirstRun = Simulate(Movement, Character, StartFrame, ResimulatedFrames);
+
+			Movement->RestoreSnapshot(Start);
+			FPBMovementSnapshot Restored;
+			Movement->CaptureSnapshot(Restored);
+			TestTrue(FString::Printf(TEXT("%s: restoring a snapshot puts back exactly what was captured"), What), Restored == Start);
+
+			const FPBMovementSnapshot SecondRun = Simulate(Movement, Character, StartFrame, ResimulatedFrames);
+			TestTrue(FString::Printf(TEXT("%s: re-simulating from a snapshot ends exactly where the first run did"), What), SecondRun == FirstRun);
+			TestFalse(FString::Printf(TEXT("%s: the character actually moved"), What), FirstRun.Location.Equals(Start.Location));
+
+			// Back to the start, for the caller to carry on from
+			Movement->RestoreSnapshot(Start);
+		};
+
+		Simulate(Movement, Character, 0, MovingStartFrame);
+		TestResimulation(TEXT("Moving"), MovingStartFrame);
+
+		// Carry on from the moving start until we've come to rest
+		Simulate(Movement, Character, MovingStartFrame, RestingStartFrame - MovingStartFrame);
+		if (TestTrue(TEXT("Came to rest"), Movement->IsResting()))
+		{
+			TestResimulation(TEXT("Resting"), RestingStartFrame);
+		}
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
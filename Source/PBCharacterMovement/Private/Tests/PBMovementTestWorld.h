@@ -0,0 +1,74 @@
+// Copyright Project Borealis
+
+#pragma once
+
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+
+#include "Character/PBPlayerCharacter.h"
+#include "Character/PBPlayerMovement.h"
+
+/** A throwaway game world to build test geometry in and drive PB characters through it, without possessing them */
+struct FPBMovementTestWorld
+{
+	static constexpr float FrameTime = 1.0f / 60.0f;
+
+	FPBMovementTestWorld()
+	{
+		World = UWorld::CreateWorld(EWorldType::Game, false);
+		FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+		WorldContext.SetCurrentWorld(World);
+		World->InitializeActorsForPlay(FURL());
+		World->BeginPlay();
+
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	}
+
+	~FPBMovementTestWorld()
+	{
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(false);
+	}
+
+	FPBMovementTestWorld(const FPBMovementTestWorld&) = delete;
+	FPBMovementTestWorld& operator=(const FPBMovementTestWorld&) = delete;
+
+	/** A static box centered on Center, Size across */
+	AStaticMeshActor* SpawnBox(const FVector& Center, const FVector& Size, const FRotator& Rotation = FRotator::ZeroRotator)
+	{
+		AStaticMeshActor* Box = World->SpawnActor<AStaticMeshActor>(Center, Rotation, SpawnParams);
+		// The engine cube is 100 units across
+		Box->GetStaticMeshComponent()->SetStaticMesh(LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube")));
+		Box->SetActorScale3D(Size / 100.0f);
+		return Box;
+	}
+
+	/** A big flat floor with its top at Z = 0 */
+	AStaticMeshActor* SpawnFloor()
+	{
+		return SpawnBox(FVector(0.0f, 0.0f, -50.0f), FVector(100000.0f, 100000.0f, 100.0f));
+	}
+
+	/** A PB character that moves without a controller, driven by TickCharacter */
+	APBPlayerCharacter* SpawnCharacter(const FVector& Location, const FRotator& Rotation = FRotator::ZeroRotator)
+	{
+		APBPlayerCharacter* Character = World->SpawnActor<APBPlayerCharacter>(Location, Rotation, SpawnParams);
+		if (Character)
+		{
+			Character->GetMovementPtr()->bRunPhysicsWithNoController = true;
+		}
+		return Character;
+	}
+
+	/** Run one frame of movement, with input already added */
+	static void TickCharacter(APBPlayerCharacter* Character)
+	{
+		Character->GetCharacterMovement()->TickComponent(FrameTime, LEVELTICK_All, nullptr);
+	}
+
+	UWorld* World = nullptr;
+	FActorSpawnParameters SpawnParams;
+};
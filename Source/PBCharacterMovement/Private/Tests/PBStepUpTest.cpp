@@ -0,0 +1,130 @@
+// Copyright Project Borealis
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "PBMovementTestWorld.h"
+
+namespace PBStepUpTest
+{
+	constexpr float StepRise = 12.0f;
+	constexpr float StepTread = 30.0f;
+	constexpr int32 NumSteps = 8;
+	/** How far apart the two step ups may end, they slide and find floors differently */
+	constexpr float ParityTolerance = 10.0f;
+
+	/** A box whose top face starts at Start and runs Length along Rotation's forward */
+	void SpawnRamp(FPBMovementTestWorld& TestWorld, const FVector& Start, float Length, float Width, const FRotator& Rotation)
+	{
+		constexpr float Thickness = 100.0f;
+		const FVector Center = Start - Rotation.RotateVector(FVector(-Length * 0.5f, 0.0f, Thickness * 0.5f));
+		TestWorld.SpawnBox(Center, FVector(Length, Width, Thickness), Rotation);
+	}
+
+	struct FScenario
+	{
+		const TCHAR* Name;
+		/** Builds the geometry, returns where the character starts */
+		FVector (*Build)(FPBMovementTestWorld& TestWorld);
+		FVector InputDirection;
+		int32 NumFrames;
+	};
+
+	FVector BuildStairs(FPBMovementTestWorld& TestWorld)
+	{
+		// Each step runs on under the ones above it, out to a landing at the top
+		constexpr float StairsStart = 100.0f;
+		constexpr float StairsEnd = StairsStart + NumSteps * StepTread + 2000.0f;
+		for (int32 Step = 0; Step < NumSteps; Step++)
+		{
+			const float StepStart = StairsStart + Step * StepTread;
+			const float Height = (Step + 1) * StepRise;
+			TestWorld.SpawnBox(FVector((StepStart + StairsEnd) * 0.5f, 0.0f, Height * 0.5f), FVector(StairsEnd - StepStart, 400.0f, Height));
+		}
+		return FVector(0.0f, 0.0f, 100.0f);
+	}
+
+	FVector BuildRamp(FPBMovementTestWorld& TestWorld)
+	{
+		SpawnRamp(TestWorld, FVector(100.0f, 0.0f, 0.0f), 2000.0f, 400.0f, FRotator(20.0f, 0.0f, 0.0f));
+		return FVector(0.0f, 0.0f, 100.0f);
+	}
+
+	FVector BuildSurfRamp(FPBMovementTestWorld& TestWorld)
+	{
+		// Too steep to walk, we land on it from above and slide along it
+		SpawnRamp(TestWorld, FVector(-1000.0f, -300.0f, 300.0f), 3000.0f, 600.0f, FRotator(0.0f, 0.0f, 50.0f));
+		return FVector(0.0f, -100.0f, 700.0f);
+	}
+
+	const FScenario Scenarios[] = {
+		{TEXT("Stairs"), &BuildStairs, FVector(1.0f, 0.0f, 0.0f), 150},
+		{TEXT("Ramp"), &BuildRamp, FVector(1.0f, 0.0f, 0.0f), 150},
+		{TEXT("Surf"), &BuildSurfRamp, FVector(1.0f, 0.0f, 0.0f), 90},
+	};
+
+	struct FRunResult
+	{
+		FVector Location = FVector::ZeroVector;
+		uint32 Sweeps = 0;
+		bool bSpawned = false;
+	};
+
+	FRunResult Run(const FScenario& Scenario, bool bUseSourceStepUp)
+	{
+		FRunResult Result;
+		FPBMovementTestWorld TestWorld;
+		TestWorld.SpawnFloor();
+		APBPlayerCharacter* Character = TestWorld.SpawnCharacter(Scenario.Build(TestWorld));
+		if (!Character)
+		{
+			return Result;
+		}
+
+		UPBPlayerMovement* Movement = Character->GetMovementPtr();
+		Movement->bUseSourceStepUp = bUseSourceStepUp;
+		for (int32 Frame = 0; Frame < Scenario.NumFrames; Frame++)
+		{
+			Character->AddMovementInput(Scenario.InputDirection);
+			FPBMovementTestWorld::TickCharacter(Character);
+		}
+
+		Result.Location = Character->GetActorLocation();
+		Result.Sweeps = Movement->GetStepUpSweepCount();
+		Result.bSpawned = true;
+		return Result;
+	}
+} // namespace PBStepUpTest
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPBStepUpParityTest, "PBCharacterMovement.StepUp", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FPBStepUpParityTest::RunTest(const FString& Parameters)
+{
+	using namespace PBStepUpTest;
+
+	for (const FScenario& Scenario : Scenarios)
+	{
+		const FRunResult Source = Run(Scenario, true);
+		const FRunResult Engine = Run(Scenario, false);
+		if (!TestTrue(FString::Printf(TEXT("%s: spawned a PB character"), Scenario.Name), Source.bSpawned && Engine.bSpawned))
+		{
+			continue;
+		}
+
+		AddInfo(FString::Printf(TEXT("%s: %u step up sweeps with Source step up, %u with the engine's"), Scenario.Name, Source.Sweeps, Engine.Sweeps));
+		TestTrue(FString::Printf(TEXT("%s: Source step up ends where the engine's does"), Scenario.Name), Source.Location.Equals(Engine.Location, ParityTolerance));
+		TestTrue(FString::Printf(TEXT("%s: Source step up sweeps no more than the engine's"), Scenario.Name), Source.Sweeps <= Engine.Sweeps);
+
+		// The stairs only prove anything if we went up them
+		if (Scenario.Build == &BuildStairs)
+		{
+			TestTrue(TEXT("Stairs: stepped up"), Source.Sweeps > 0);
+			TestTrue(TEXT("Stairs: climbed to the top"), Source.Location.Z > NumSteps * StepRise);
+		}
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
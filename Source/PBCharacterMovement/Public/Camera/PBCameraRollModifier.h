@@ -0,0 +1,20 @@
+// Copyright Project Borealis
+
+#pragma once
+
+#include "Camera/CameraModifier.h"
+
+#include "PBCameraRollModifier.generated.h"
+
+/**
+ * Rolls the view with sideways velocity, like Source's view roll.
+ * Applied to the camera only, so the roll never gets into the control rotation, aim or move packets.
+ */
+UCLASS()
+class PBCHARACTERMOVEMENT_API UPBCameraRollModifier : public UCameraModifier
+{
+	GENERATED_BODY()
+
+public:
+	bool ModifyCamera(float DeltaTime, FMinimalViewInfo& InOutPOV) override;
+};
@@ -0,0 +1,20 @@
+// Copyright Project Borealis
+
+#pragma once
+
+#include "Camera/CameraModifier.h"
+
+#include "PBLateLatchCameraModifier.generated.h"
+
+/**
+ * Adds look input the controller hasn't applied to its rotation yet to the view, at the camera update right before view setup.
+ * The controller applies the same input on its next rotation update, so the simulated control rotation catches up with what was shown.
+ */
+UCLASS()
+class PBCHARACTERMOVEMENT_API UPBLateLatchCameraModifier : public UCameraModifier
+{
+	GENERATED_BODY()
+
+public:
+	bool ModifyCamera(float DeltaTime, FMinimalViewInfo& InOutPOV) override;
+};
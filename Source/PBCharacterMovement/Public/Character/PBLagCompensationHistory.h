@@ -0,0 +1,66 @@
+// Copyright Project Borealis
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UPBPlayerMovement;
+
+/** A character's capsule at a point in server time */
+struct FPBLagCompensationSample
+{
+	double Time = 0.0;
+	FVector Location = FVector::ZeroVector;
+	/** Unscaled capsule half-height, which moves smoothly through a crouch transition */
+	float HalfHeight = 0.0f;
+	float CrouchAlpha = 0.0f;
+};
+
+/** One rewind in a batch: whose capsule, and at what server time */
+struct FPBLagCompensationQuery
+{
+	const UPBPlayerMovement* Movement = nullptr;
+	double Time = 0.0;
+};
+
+/**
+ * Fixed size ring of past capsules for hit registration.
+ * Kept as parallel arrays so a rewind's search only walks the times.
+ */
+class PBCHARACTERMOVEMENT_API FPBLagCompensationHistory
+{
+public:
+	/** Allocate room for Capacity samples, dropping any recorded */
+	void Init(int32 Capacity);
+
+	/** Drop every sample, e.g. on teleport or respawn, so rewinds don't sweep across the gap */
+	void Reset();
+
+	/** Add a sample, replacing the newest if it has the same time. Times must not go backwards. */
+	void Record(double Time, const FVector& Location, float HalfHeight, float CrouchAlpha);
+
+	/**
+	 * Capsule at Time, interpolated between the samples either side of it.
+	 * Clamps to the oldest or newest sample outside of the history.
+	 * @return false if there are no samples, or Time is older than the oldest
+	 */
+	bool Rewind(double Time, FPBLagCompensationSample& OutSample) const;
+
+	int32 Num() const { return Count; }
+	int32 GetCapacity() const { return Times.Num(); }
+
+	/** Oldest time we can rewind to without clamping, 0 if empty */
+	double GetOldestTime() const { return Count > 0 ? Times[ToSlot(0)] : 0.0; }
+
+private:
+	/** Ring slot of the Index'th oldest sample */
+	int32 ToSlot(int32 Index) const { return (Head + Index) % Times.Num(); }
+
+	TArray<double> Times;
+	TArray<FVector> Locations;
+	TArray<float> HalfHeights;
+	TArray<float> CrouchAlphas;
+	/** Slot of the oldest sample */
+	int32 Head = 0;
+	int32 Count = 0;
+};
@@ -0,0 +1,126 @@
+// Copyright Project Borealis
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <type_traits>
+
+/**
+ * Everything PB movement needs to re-simulate a character from a point in time, for rollback.
+ * Flat and trivially copyable, so keeping or rewinding a history of snapshots is one small memcpy per character.
+ * Capturing and restoring is field by field, most of this state lives in engine members of the movement and character we can't lay out.
+ * Movement bases aren't captured, a character on a moving platform needs its base rewound too.
+ */
+struct FPBMovementSnapshot
+{
+	// Transform and motion
+	FVector Location = FVector::ZeroVector;
+	FQuat Rotation = FQuat::Identity;
+	FVector Velocity = FVector::ZeroVector;
+	FVector Acceleration = FVector::ZeroVector;
+
+	/** Unscaled capsule half-height, mid crouch transition it's neither standing nor crouched */
+	float CapsuleHalfHeight = 0.0f;
+
+	// Jump
+	float JumpKeyHoldTime = 0.0f;
+	float JumpForceTimeRemaining = 0.0f;
+	float JumpBoostElapsedTime = 0.0f;
+	float JumpBoostElapsedTimePreJump = 0.0f;
+	int32 JumpCurrentCount = 0;
+	int32 JumpCurrentCountPreJump = 0;
+
+	// Floor and ground
+	float MaxStepHeight = 0.0f;
+	float WalkableFloorZ = 0.0f;
+	float SurfaceFriction = 1.0f;
+	float BrakingWindowTimeElapsed = 0.0f;
+	int32 IdleTicks = 0;
+	/** Resting wakes up if we're moved away from here or touched, so a restored rest must check against where it began */
+	FVector RestingLocation = FVector::ZeroVector;
+	int32 RestingOverlapCount = 0;
+
+	// Crouch, slide and ladder
+	float CrouchAlpha = 0.0f;
+	float CrouchSlideElapsedTime = 0.0f;
+	float OffLadderTicks = 0.0f;
+
+	uint8 MovementMode = 0;
+	uint8 CustomMovementMode = 0;
+	uint8 DeferredMovementMode = 0;
+
+	bool bIsCrouched = false;
+	bool bWantsToCrouch = false;
+	bool bLockInCrouch = false;
+	bool bIsInCrouchTransition = false;
+	bool bCrouchFrameTolerated = false;
+	bool bCrouchSliding = false;
+	bool bDeferCrouchSlideToLand = false;
+	bool bOnLadder = false;
+	bool bPressedJump = false;
+	bool bWasJumping = false;
+	bool bDeferJumpStop = false;
+	bool bIsSprinting = false;
+	bool bWantsToWalk = false;
+	bool bBrakingFrameTolerated = false;
+	bool bHasEverLanded = false;
+	bool bSlidingInAir = false;
+	bool bWasSlidingInAir = false;
+	bool bHasDeferredMovementMode = false;
+	bool bIsResting = false;
+
+	/** Field by field, padding makes comparing the bytes unreliable */
+	bool operator==(const FPBMovementSnapshot& Other) const
+	{
+		return Location == Other.Location &&
+			Rotation == Other.Rotation &&
+			Velocity == Other.Velocity &&
+			Acceleration == Other.Acceleration &&
+			CapsuleHalfHeight == Other.CapsuleHalfHeight &&
+			JumpKeyHoldTime == Other.JumpKeyHoldTime &&
+			JumpForceTimeRemaining == Other.JumpForceTimeRemaining &&
+			JumpBoostElapsedTime == Other.JumpBoostElapsedTime &&
+			JumpBoostElapsedTimePreJump == Other.JumpBoostElapsedTimePreJump &&
+			JumpCurrentCount == Other.JumpCurrentCount &&
+			JumpCurrentCountPreJump == Other.JumpCurrentCountPreJump &&
+			MaxStepHeight == Other.MaxStepHeight &&
+			WalkableFloorZ == Other.WalkableFloorZ &&
+			SurfaceFriction == Other.SurfaceFriction &&
+			BrakingWindowTimeElapsed == Other.BrakingWindowTimeElapsed &&
+			IdleTicks == Other.IdleTicks &&
+			RestingLocation == Other.RestingLocation &&
+			RestingOverlapCount == Other.RestingOverlapCount &&
+			CrouchAlpha == Other.CrouchAlpha &&
+			CrouchSlideElapsedTime == Other.CrouchSlideElapsedTime &&
+			OffLadderTicks == Other.OffLadderTicks &&
+			MovementMode == Other.MovementMode &&
+			CustomMovementMode == Other.CustomMovementMode &&
+			DeferredMovementMode == Other.DeferredMovementMode &&
+			bIsCrouched == Other.bIsCrouched &&
+			bWantsToCrouch == Other.bWantsToCrouch &&
+			bLockInCrouch == Other.bLockInCrouch &&
+			bIsInCrouchTransition == Other.bIsInCrouchTransition &&
+			bCrouchFrameTolerated == Other.bCrouchFrameTolerated &&
+			bCrouchSliding == Other.bCrouchSliding &&
+			bDeferCrouchSlideToLand == Other.bDeferCrouchSlideToLand &&
+			bOnLadder == Other.bOnLadder &&
+			bPressedJump == Other.bPressedJump &&
+			bWasJumping == Other.bWasJumping &&
+			bDeferJumpStop == Other.bDeferJumpStop &&
+			bIsSprinting == Other.bIsSprinting &&
+			bWantsToWalk == Other.bWantsToWalk &&
+			bBrakingFrameTolerated == Other.bBrakingFrameTolerated &&
+			bHasEverLanded == Other.bHasEverLanded &&
+			bSlidingInAir == Other.bSlidingInAir &&
+			bWasSlidingInAir == Other.bWasSlidingInAir &&
+			bHasDeferredMovementMode == Other.bHasDeferredMovementMode &&
+			bIsResting == Other.bIsResting;
+	}
+	bool operator!=(const FPBMovementSnapshot& Other) const
+	{
+		return !(*this == Other);
+	}
+};
+
+static_assert(std::is_trivially_copyable_v<FPBMovementSnapshot>, "FPBMovementSnapshot must stay a flat memcpy");
@@ -0,0 +1,136 @@
+// Copyright Project Borealis
+
+#pragma once
+
+#include "Subsystems/WorldSubsystem.h"
+#include "Tasks/Task.h"
+
+#include "PBMovementValidationSubsystem.generated.h"
+
+class UPBPlayerMovement;
+
+/** Which PB movement rule a client's reported move broke */
+UENUM(BlueprintType)
+enum class EPBMovementViolation : uint8
+{
+	None,
+	/** Faster than AxisSpeedLimit on an axis */
+	AxisSpeed,
+	/** Faster on the ground than GetMaxSpeed allows */
+	GroundSpeed,
+	/** More air acceleration than AirSpeedCap allows */
+	AirAcceleration,
+	/** Rising faster than a jump from DoJump can */
+	JumpVelocity,
+	/** Faster than a crouch slide boost can make you */
+	SlideBoost,
+};
+
+/** PB rules as they were for one move, captured on the game thread so workers never touch the movement component */
+struct FPBMovementValidationLimits
+{
+	float MaxSpeed = 0.0f;
+	float AirSpeedCap = 0.0f;
+	float JumpZVelocity = 0.0f;
+	/** Most horizontal speed a jump can add, from jump boost or an air jump dash */
+	float JumpSpeedAllowance = 0.0f;
+	float MinCrouchSlideBoost = 0.0f;
+	float CrouchSlideBoostMultiplier = 1.0f;
+	float AxisSpeedLimit = 0.0f;
+	float MaxStepHeight = 0.0f;
+	/** Rise per unit of ground travel on the steepest walkable floor */
+	float MaxWalkableRise = 1.0f;
+	float MaxSimulationTimeStep = 0.0f;
+	/** Scale on every speed bound, for timing jitter between client and server */
+	float SpeedTolerance = 1.0f;
+	/** Distance added to every displacement bound, for position quantisation and small corrections */
+	float PositionTolerance = 0.0f;
+	float SuspicionThreshold = 0.0f;
+	float SuspicionDecayRate = 0.0f;
+};
+
+/** A client's reported outcome of one move */
+struct FPBMovementValidationSample
+{
+	FPBMovementValidationLimits Limits;
+	FVector ClientLocation = FVector::ZeroVector;
+	/** When the client made the move. Moves we don't check, like the first half of a dual move, fall between samples. */
+	float ClientTimeStamp = 0.0f;
+	float DeltaTime = 0.0f;
+	bool bFalling = false;
+	bool bCrouchSliding = false;
+	bool bJumping = false;
+	/** Teleport, launch, moving base or a mode we don't validate: only take the new location, don't check how we got there */
+	bool bDiscontinuous = false;
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FPBSuspiciousMovementSignature, UPBPlayerMovement*, Movement, EPBMovementViolation, Violation, float, Suspicion);
+
+/**
+ * Checks clients' reported moves against PB movement rules, on worker threads, for anti-cheat.
+ * Samples are queued from the server's position error check. Each tick, if the last batch is done, its results are
+ * handed out and everything queued since goes to the workers. Movement never waits on validation.
+ * A single bad move is usually a collision or timing glitch, so a player is only flagged once violations add up
+ * faster than they decay.
+ */
+UCLASS()
+class PBCHARACTERMOVEMENT_API UPBMovementValidationSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	void Deinitialize() override;
+	void Tick(float DeltaTime) override;
+	TStatId GetStatId() const override;
+
+	/** Queue a move for the next batch. Game thread only. */
+	void QueueSample(UPBPlayerMovement* Movement, const FPBMovementValidationSample& Sample);
+
+	/** Worker time the last batch spent on this player, in microseconds */
+	float GetValidationCost(const UPBPlayerMovement* Movement) const;
+
+	/** Called on the game thread when a player's violations pass their suspicion threshold */
+	UPROPERTY(BlueprintAssignable, Category = "PB Movement Validation")
+	FPBSuspiciousMovementSignature OnSuspiciousMovement;
+
+protected:
+	bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+	struct FPlayer
+	{
+		TWeakObjectPtr<UPBPlayerMovement> Movement;
+		/** Samples the workers are on, or about to be */
+		TArray<FPBMovementValidationSample> Samples;
+		FVector LastLocation = FVector::ZeroVector;
+		FVector LastVelocity = FVector::ZeroVector;
+		float LastTimeStamp = 0.0f;
+		bool bHasLastLocation = false;
+		bool bHasLastVelocity = false;
+		float Suspicion = 0.0f;
+		/** Batch results, for the game thread */
+		EPBMovementViolation FlaggedViolation = EPBMovementViolation::None;
+		float FlaggedSuspicion = 0.0f;
+		uint32 Violations = 0;
+		float CostMicroseconds = 0.0f;
+		/** CostMicroseconds of the last finished batch, game thread only */
+		float LastCostMicroseconds = 0.0f;
+	};
+
+	/** Check a player's samples in order. Runs on a worker, only touches Player. */
+	static void ValidatePlayer(FPlayer& Player);
+	static EPBMovementViolation ValidateSample(FPlayer& Player, const FPBMovementValidationSample& Sample);
+
+	/** Hand out the finished batch's results and drop players that are gone */
+	void ApplyResults();
+
+	/** Owned by the workers while a batch is in flight */
+	TArray<FPlayer> Players;
+	TMap<TObjectKey<UPBPlayerMovement>, int32> PlayerIndices;
+
+	/** Samples queued since the last batch started, game thread only */
+	TMap<TObjectKey<UPBPlayerMovement>, TArray<FPBMovementValidationSample>> PendingSamples;
+
+	UE::Tasks::FTask BatchTask;
+	bool bHasBatchResults = false;
+};
@@ -6,10 +6,41 @@
 
 #include "PBPlayerCharacter.generated.h"
 
+struct FPBMovementSnapshot;
+
+class UCameraModifier;
 class USoundCue;
 class UPBMoveStepSound;
 class UPBPlayerMovement;
 
+/** How often a PB character needs replicating, from how much its movement is changing */
+UENUM(BlueprintType)
+enum class EPBNetUpdateTier : uint8
+{
+	Idle,
+	Moving,
+	Fast,
+};
+
+/** Input acceleration, compressed so simulated proxies can steer between movement updates */
+USTRUCT()
+struct FPBReplicatedAcceleration
+{
+	GENERATED_BODY()
+
+	/** Direction of XY acceleration, [0, 2PI] quantised to [0, 255] */
+	UPROPERTY()
+	uint8 AccelXYRadians = 0;
+
+	/** Size of XY acceleration, [0, MaxAcceleration] quantised to [0, 255] */
+	UPROPERTY()
+	uint8 AccelXYMagnitude = 0;
+
+	/** Z acceleration, [-MaxAcceleration, MaxAcceleration] quantised to [-127, 127] */
+	UPROPERTY()
+	int8 AccelZ = 0;
+};
+
 inline float SimpleSpline(float Value)
 {
 	const float ValueSquared = Value * Value;
@@ -30,11 +61,16 @@ public:
 	void BeginPlay() override;
 	void Tick(float DeltaTime) override;
 
+	/** Add our camera modifiers to the local player's camera */
+	void PawnClientRestart() override;
+
 	void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
 
 	/* Triggered when player's movement mode has changed */
 	void OnMovementModeChanged(EMovementMode PrevMovementMode, uint8 PrevCustomMode) override;
 
+	void CheckJumpInput(float DeltaTime) override;
 	void ClearJumpInput(float DeltaTime) override;
 	void Jump() override;
 	void StopJumping() override;
@@ -111,6 +147,50 @@ public:
 	UFUNCTION()
 	void CrouchToggle();
 
+	/**
+	 * Platform time (FPlatformTime::Seconds) of the input event about to be dispatched, for sub-tick input (move.SubTickInput).
+	 * Input layers that know when their events happened set this before calling MoveForward, MoveRight, Jump or the crouch inputs.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "PB Player|Input")
+	void SetInputEventTime(double EventTime)
+	{
+		InputEventTime = EventTime;
+	}
+
+	/** Advance the jump boost throttle by a move's time, so replays and rollback see the same throttle */
+	void AdvanceJumpBoostTime(float DeltaSeconds)
+	{
+		JumpBoostElapsedTime = FMath::Min(JumpBoostElapsedTime + DeltaSeconds, UE_BIG_NUMBER);
+	}
+	float GetJumpBoostElapsedTime() const
+	{
+		return JumpBoostElapsedTime;
+	}
+	void SetJumpBoostElapsedTime(float Time)
+	{
+		JumpBoostElapsedTime = Time;
+	}
+	/** JumpBoostElapsedTime before CheckJumpInput, like JumpCurrentCountPreJump. Saved moves need this, a jump has already reset it. */
+	float GetJumpBoostElapsedTimePreJump() const
+	{
+		return JumpBoostElapsedTimePreJump;
+	}
+
+	/** Our part of a movement snapshot, see UPBPlayerMovement::CaptureSnapshot */
+	void CaptureMovementSnapshot(FPBMovementSnapshot& OutSnapshot) const;
+	void RestoreMovementSnapshot(const FPBMovementSnapshot& Snapshot);
+
+	/** Earliest timestamped input change since the last call, 0 if none */
+	double ConsumeSubTickInputTime();
+
+	/** Platform time of the earliest input since the last call, for input latency stats. 0 if none. */
+	double ConsumeInputLatencyTag()
+	{
+		const double Time = InputLatencyTagTime;
+		InputLatencyTagTime = 0.0;
+		return Time;
+	}
+
 	/** */
 	UFUNCTION(BlueprintCallable)
 	bool CanWalkOn(const FHitResult& Hit) const;
@@ -185,6 +265,23 @@ public:
 		bSuitEquipped = bEquipped;
 	}
 
+	/** Crouch progress as replicated to simulated proxies, 0 standing and 1 crouched */
+	UFUNCTION(Category = "PB Getters", BlueprintPure)
+	float GetReplicatedCrouchAlpha() const
+	{
+		return ReplicatedCrouchAlpha / 255.0f;
+	}
+	/** Capsule crouch progress as replicated to simulated proxies, which their mesh follows, see UPBPlayerMovement::GetCapsuleCrouchAlpha */
+	float GetReplicatedCapsuleCrouchAlpha() const
+	{
+		return ReplicatedCapsuleCrouchAlpha / 255.0f;
+	}
+	void SetReplicatedCrouchAlpha(float Alpha, float CapsuleAlpha)
+	{
+		ReplicatedCrouchAlpha = FMath::Quantize8UnsignedByte(Alpha);
+		ReplicatedCapsuleCrouchAlpha = FMath::Quantize8UnsignedByte(CapsuleAlpha);
+	}
+
 	UFUNCTION(Category = "PB Getters", BlueprintPure)
 	float GetDefaultBaseEyeHeight() const
 	{
@@ -212,6 +309,23 @@ public:
 	UFUNCTION()
 	void ToggleNoClip();
 
+	/** Move the mesh and eyes of a simulated proxy to match the replicated crouch progress */
+	void ApplyProxyCrouchAlpha();
+
+	/**
+	 * Return the character and its movement to spawn defaults, so a pooled actor can be recycled instead of respawned.
+	 * Doesn't move the character, teleport it to its spawn after calling this.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "PB Player")
+	void ResetCharacterState();
+
+	/** Current net update tier, only meaningful on the server */
+	UFUNCTION(Category = "PB Getters", BlueprintPure)
+	EPBNetUpdateTier GetNetUpdateTier() const
+	{
+		return NetUpdateTier;
+	}
+
 protected:
 	/** Returns Mesh1P subobject **/
 	FORCEINLINE USkeletalMeshComponent* GetMesh1P() const { return Mesh1P; }
@@ -220,6 +334,64 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera)
 	float FullCrouchedEyeHeight;
 
+	/** Camera modifier that rolls the view with sideways velocity, none to not roll */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Camera")
+	TSubclassOf<UCameraModifier> CameraRollModifierClass;
+
+	/** Camera modifier that shows look input the controller hasn't applied yet, added if late latching is on */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Camera")
+	TSubclassOf<UCameraModifier> LateLatchModifierClass;
+
+	/** Show look input that arrives after the controller's rotation update on the camera straight away, rather than a frame later */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Camera")
+	bool bLateLatchViewRotation = false;
+
+	/** Pick the net update tier for our movement, raising it right away and lowering it after a hold time */
+	void UpdateNetUpdateTier(float DeltaTime);
+
+	/** Net update frequency and priority for a tier */
+	void ApplyNetUpdateTier(EPBNetUpdateTier Tier);
+
+	/** Scale net update frequency and priority with how fast our movement is changing */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking")
+	bool bUseAdaptiveNetUpdateFrequency = true;
+
+	/** Net update frequency when standing still */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking", meta = (ClampMin = "1", UIMin = "1"))
+	float IdleNetUpdateFrequency = 10.0f;
+
+	/** Net update frequency when moving on the ground */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking", meta = (ClampMin = "1", UIMin = "1"))
+	float MovingNetUpdateFrequency = 30.0f;
+
+	/** Net update frequency when fast or airborne */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking", meta = (ClampMin = "1", UIMin = "1"))
+	float FastNetUpdateFrequency = 100.0f;
+
+	/** Net priority when standing still */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking", meta = (ClampMin = "0", UIMin = "0"))
+	float IdleNetPriority = 2.0f;
+
+	/** Net priority when moving on the ground */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking", meta = (ClampMin = "0", UIMin = "0"))
+	float MovingNetPriority = 3.0f;
+
+	/** Net priority when fast or airborne */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking", meta = (ClampMin = "0", UIMin = "0"))
+	float FastNetPriority = 4.0f;
+
+	/** Ground speed above which we use the fast tier */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking", meta = (ClampMin = "0", UIMin = "0"))
+	float FastNetUpdateSpeed = 450.0f;
+
+	/** Change in acceleration that counts as a change of direction, bumping the tier up */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking", meta = (ClampMin = "0", UIMin = "0"))
+	float NetUpdateAccelerationChange = 100.0f;
+
+	/** Seconds a lower tier has to be wanted before we drop to it */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "PB Player|Networking", meta = (ClampMin = "0", UIMin = "0", ForceUnits = "s"))
+	float NetUpdateTierHoldTime = 0.5f;
+
 private:
 	/** pawn mesh: 1st person view */
 	UPROPERTY(VisibleDefaultsOnly, Category = Mesh)
@@ -228,8 +400,9 @@ private:
 	/** cached default eye height */
 	float DefaultBaseEyeHeight;
 
-	/** throttle jump boost when going up a ramp, so we don't spam it */
-	float LastJumpBoostTime;
+	/** move time since our last jump boost, to throttle it when going up a ramp, so we don't spam it */
+	float JumpBoostElapsedTime = UE_BIG_NUMBER;
+	float JumpBoostElapsedTimePreJump = UE_BIG_NUMBER;
 
 	/** maximum time it takes to jump */
 	float MaxJumpTime;
@@ -281,6 +454,58 @@ private:
 	UPROPERTY(Transient, Replicated)
 	bool bWantsToWalk;
 
+	/** Crouch progress, quantised to a byte, so simulated proxies can crouch smoothly without resizing their capsule */
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_ReplicatedCrouchAlpha)
+	uint8 ReplicatedCrouchAlpha = 0;
+
+	/** The server capsule resizes in steps and our replicated location follows it, so the mesh offset needs the capsule's progress, not the smooth one */
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_ReplicatedCrouchAlpha)
+	uint8 ReplicatedCapsuleCrouchAlpha = 0;
+
+	UFUNCTION()
+	void OnRep_ReplicatedCrouchAlpha();
+
+	/** Input acceleration, so simulated proxies can follow air strafing between updates */
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_ReplicatedAcceleration)
+	FPBReplicatedAcceleration ReplicatedAcceleration;
+
+	UFUNCTION()
+	void OnRep_ReplicatedAcceleration();
+
 	/** defer the jump stop for a frame (for early jumps) */
 	bool bDeferJumpStop = false;
+
+	/** Note an input change at the time of the event being dispatched */
+	void NoteSubTickInput();
+
+	/** Start timing input latency from now, unless we're already timing an earlier input */
+	void TagInputLatency()
+	{
+		if (InputLatencyTagTime <= 0.0)
+		{
+			InputLatencyTagTime = FPlatformTime::Seconds();
+		}
+	}
+
+	/** earliest input not yet carried by a move, 0 if none */
+	double InputLatencyTagTime = 0.0;
+
+	/** time of the input event being dispatched, 0 if unknown */
+	double InputEventTime = 0.0;
+
+	/** earliest timestamped input change this frame, 0 if none */
+	double SubTickInputTime = 0.0;
+
+	/** last movement input, so we only split moves when a direction is pressed or released */
+	float LastMoveForwardInput = 0.0f;
+	float LastMoveRightInput = 0.0f;
+
+	/** net update tier we're replicating at */
+	EPBNetUpdateTier NetUpdateTier = EPBNetUpdateTier::Fast;
+
+	/** how long we've wanted a lower tier than the current one */
+	float NetUpdateTierLowerTime = 0.0f;
+
+	/** acceleration when we last picked a tier */
+	FVector LastNetUpdateAcceleration = FVector::ZeroVector;
 };
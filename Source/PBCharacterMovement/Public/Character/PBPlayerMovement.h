@@ -4,10 +4,17 @@
 
 #include "GameFramework/CharacterMovementComponent.h"
 
+#include "PBLagCompensationHistory.h"
 #include "PBPlayerCharacter.h"
+#include "PBTrajectoryPrediction.h"
 
 #include "PBPlayerMovement.generated.h"
 
+// Move and jump sounds and pos printing are only for players to see and hear, so server builds leave them out
+#ifndef PB_WITH_COSMETICS
+#define PB_WITH_COSMETICS !UE_SERVER
+#endif
+
 constexpr float LADDER_MOUNT_TIMEOUT = 0.2f;
 
 // Crouch Timings (in seconds)
@@ -17,9 +24,94 @@ constexpr float MOVEMENT_DEFAULT_UNCROUCHTIME = 0.2f;
 constexpr float MOVEMENT_DEFAULT_UNCROUCHJUMPTIME = 0.8f;
 
 class USoundCue;
+class UPBPlayerMovement;
+struct FPBMovementSnapshot;
 
 constexpr float DesiredGravity = -1143.0f;
 
+/** How much of the simulation an AI controlled PB character runs, from how relevant it is to players */
+UENUM(BlueprintType)
+enum class EPBMovementLOD : uint8
+{
+	Full,
+	Reduced,
+	Minimal,
+};
+
+/** Saved move that carries PB movement intent, so the server and replays use the same max speed as the client did */
+class PBCHARACTERMOVEMENT_API FSavedMove_PB : public FSavedMove_Character
+{
+public:
+	typedef FSavedMove_Character Super;
+
+	/** Compressed flags for PB intent, on top of jump and crouch */
+	enum CompressedFlags
+	{
+		FLAG_Sprinting = FLAG_Custom_0,
+		FLAG_WantsToWalk = FLAG_Custom_1,
+		FLAG_LockInCrouch = FLAG_Custom_2,
+	};
+
+	void Clear() override;
+	void SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData) override;
+	void PrepMoveFor(ACharacter* C) override;
+	bool CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const override;
+	uint8 GetCompressedFlags() const override;
+
+	void CombineWith(const FSavedMove_Character* OldMove, ACharacter* InCharacter, APlayerController* PC, const FVector& OldStartLocation) override;
+
+	uint32 bSavedSprinting : 1;
+	uint32 bSavedWantsToWalk : 1;
+	uint32 bSavedLockInCrouch : 1;
+
+	// PB movement state at the start of the move, restored before replaying it
+	uint32 bSavedBrakingFrameTolerated : 1;
+	uint32 bSavedCrouchFrameTolerated : 1;
+	uint32 bSavedWasSlidingInAir : 1;
+	uint32 bSavedInCrouchTransition : 1;
+	uint32 bSavedCrouchSliding : 1;
+	uint32 bSavedDeferCrouchSlideToLand : 1;
+	float SavedBrakingWindowTimeElapsed;
+	float SavedSurfaceFriction;
+	float SavedCrouchSlideElapsedTime;
+	float SavedJumpBoostElapsedTime;
+
+	/** Platform time of the earliest input this move carries, for latency stats. 0 if none. */
+	double SavedInputTime;
+	/** Platform time this move was first sent to the server, set from CallServerMove. 0 until then. */
+	mutable double SavedSendTime;
+
+private:
+	void SaveMovementState(const class UPBPlayerMovement& Movement);
+	void RestoreMovementState(class UPBPlayerMovement& Movement) const;
+};
+
+/** Client prediction data that hands out PB saved moves from a fixed arena, so moves are recycled without allocating */
+class PBCHARACTERMOVEMENT_API FNetworkPredictionData_Client_PB : public FNetworkPredictionData_Client_Character
+{
+public:
+	typedef FNetworkPredictionData_Client_Character Super;
+
+	FNetworkPredictionData_Client_PB(const UPBPlayerMovement& ClientMovement);
+	virtual ~FNetworkPredictionData_Client_PB();
+
+	FSavedMovePtr AllocateNewMove() override;
+	FSavedMovePtr CreateSavedMove(ACharacter* C, const float DeltaTime, const FVector& NewAccel) override;
+
+	/** Most saved moves this client has had waiting for an ack at once */
+	int32 PeakInFlightMoves = 0;
+
+private:
+	/** Wrap an arena slot in a move pointer that returns the slot when released */
+	FSavedMovePtr MakeArenaMove(int32 Slot);
+
+	/** Contiguous storage for saved moves, never resized after construction since moves point into it */
+	TArray<FSavedMove_PB> MoveArena;
+
+	/** Arena slots not handed out yet */
+	TArray<int32> FreeArenaSlots;
+};
+
 UCLASS()
 class PBCHARACTERMOVEMENT_API UPBPlayerMovement : public UCharacterMovementComponent
 {
@@ -41,8 +133,8 @@ protected:
 	/** schedule a crouch slide to landing */
 	bool bDeferCrouchSlideToLand;
 
-	/** Time crouch sliding started */
-	float CrouchSlideStartTime;
+	/** Move time since crouch sliding last started, so replays agree with the original moves */
+	float CrouchSlideElapsedTime;
 
 	/** How long a crouch slide boosts for */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement: Walking")
@@ -124,6 +216,10 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement: Walking")
 	float UncrouchJumpTime;
 
+	/** Number of steps the capsule resizes in during a crouch transition, while the eyes move smoothly. 0 resizes every tick. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement: Walking", meta = (ClampMin = "0", UIMin = "0"))
+	int32 CrouchCapsuleSteps = 4;
+
 	/** Speed on a ladder */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement: Ladder")
 	float LadderSpeed;
@@ -140,6 +236,14 @@ protected:
 	UPROPERTY(Category = "Character Movement: Walking", EditAnywhere, BlueprintReadWrite)
 	float StepDownHeightFraction;
 
+	/** Step up stairs with a Source-style up, forward and down sweep rather than the engine's step up. At most four sweeps, with one slide when blocked partway forward. */
+	UPROPERTY(Category = "Character Movement: Walking", EditAnywhere, BlueprintReadWrite)
+	bool bUseSourceStepUp = true;
+
+	/** Find the floor while walking with a single Source-style downward sweep, falling if the drop is beyond the step down height */
+	UPROPERTY(Category = "Character Movement: Walking", EditAnywhere, BlueprintReadWrite)
+	bool bUseGroundSnapping = true;
+
 	/** Friction multiplier to use when on an edge */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement: Walking")
 	float EdgeFrictionMultiplier;
@@ -179,12 +283,20 @@ protected:
 	/** If the player is currently locked in crouch state */
 	bool bLockInCrouch = false;
 
+	/** Smooth crouch progress, 0 standing and 1 crouched. The capsule follows in CrouchCapsuleSteps steps. */
+	float CrouchAlpha = 0.0f;
+
+	/** The capsule crouch progress for a smooth crouch progress, never larger than the smooth capsule would be */
+	float QuantizeCrouchAlpha(float Alpha) const;
+
 	APBPlayerCharacter* GetPBCharacter() const { return PBPlayerCharacter; }
 
 	/** The PB player character */
 	UPROPERTY(Transient, DuplicateTransient)
 	TObjectPtr<APBPlayerCharacter> PBPlayerCharacter;
 
+	friend class FSavedMove_PB;
+
 	/** The target ground speed when running. */
 	UPROPERTY(Category = "Character Movement: Walking", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"))
 	float RunSpeed;
@@ -220,6 +332,20 @@ protected:
 	UPROPERTY(Category = "Character Movement: Walking", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"))
 	float AxisSpeedLimit;
 
+	/** Resolve collisions by clipping against every contact plane at once, like Source, rather than sliding one surface at a time */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (General Settings)")
+	bool bUseMultiPlaneClipping = false;
+
+	/** Maximum contact planes, and so sweeps, to collect in a single slide when using multi-plane clipping */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (General Settings)", meta = (ClampMin = "1", UIMin = "1", ClampMax = "5", UIMax = "5"))
+	int32 MaxClipPlanes = 5;
+
+	/** If collision response should use multi-plane clipping in the current movement state */
+	bool ShouldClipAgainstPlanes() const;
+
+	/** The normal the engine would slide along for this hit, adjusted to not push us up walls or into the floor */
+	FVector GetSlideNormal(const FVector& Delta, const FVector& InNormal, const FHitResult& Hit) const;
+
 	/** Threshold relating to speed ratio and friction which causes us to catch air */
 	UPROPERTY(Category = "Character Movement: Walking", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"))
 	float SlideLimit = 0.5f;
@@ -228,6 +354,19 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (General Settings)")
 	float GroundUncrouchCheckFactor = 0.75f;
 
+	/** Allow players standing still on a static floor to rest, skipping floor checks and velocity integration */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement: Walking")
+	bool bAllowResting = true;
+
+	/** Number of consecutive idle ticks before the player starts resting */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement: Walking", meta = (ClampMin = "1", UIMin = "1"))
+	int32 RestingTickThreshold = 8;
+
+	/** If nothing is moving us and our floor can't move, so there is no need to check it */
+	bool CanRest() const;
+
+	void PhysWalking(float deltaTime, int32 Iterations) override;
+
 	bool bShouldPlayMoveSounds = true;
 
 	/** Milliseconds between step sounds */
@@ -235,6 +374,183 @@ protected:
 	/** If we are stepping left, else, right */
 	bool StepSide = false;
 
+	/** Highest ping, in milliseconds, the saved move arena is sized to keep moves for */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0", ForceUnits = "ms"))
+	float SavedMoveArenaMaxPing = 500.0f;
+
+	/** Highest client tick rate, in hertz, the saved move arena is sized for */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Character Movement (Networking)", meta = (ClampMin = "1", UIMin = "1"))
+	float SavedMoveArenaTickRate = 128.0f;
+
+	/** Widen the server's position error tolerance with speed, so timing differences at bhop and surf speeds don't cause corrections */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)")
+	bool bUseSpeedScaledCorrectionTolerance = true;
+
+	/** How far apart in time, in seconds, client and server may be before a position error along our velocity needs correcting */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0", ForceUnits = "s"))
+	float CorrectionTimingTolerance = 0.008f;
+
+	/** Scale on the timing tolerance while in the air */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0"))
+	float AirCorrectionToleranceScale = 2.0f;
+
+	/** Scale on the timing tolerance while crouch sliding */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0"))
+	float SlideCorrectionToleranceScale = 1.5f;
+
+	/** Scale on the timing tolerance while on a ladder */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0"))
+	float LadderCorrectionToleranceScale = 0.5f;
+
+	/** Most extra position error we tolerate, however fast we go */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0"))
+	float MaxCorrectionTolerance = 64.0f;
+
+	/** How much tolerated error per second the server may take the client's position for, rather than keeping its own */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0"))
+	float ClientPositionAcceptRate = 32.0f;
+
+	/** Extra position error we tolerate for our current speed and movement state */
+	float GetCorrectionTolerance() const;
+
+	/** If simulated proxies should steer with their replicated acceleration and PB air rules between updates, instead of flying straight */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)")
+	bool bUsePBProxyExtrapolation = true;
+
+	/** If simulated proxies far away or off screen should only interpolate their replicated transform, skipping floor queries and cosmetics */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)")
+	bool bUseLightweightProxies = true;
+
+	/** Distance from the local view beyond which a simulated proxy goes lightweight, 0 to never go lightweight from distance */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bUseLightweightProxies"))
+	float LightweightProxyDistance = 3000.0f;
+
+	/** If a simulated proxy that hasn't been rendered for LightweightProxyRenderTime goes lightweight */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (EditCondition = "bUseLightweightProxies"))
+	bool bLightweightWhenNotRendered = true;
+
+	/** How long a simulated proxy may go unrendered before it goes lightweight */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bUseLightweightProxies"))
+	float LightweightProxyRenderTime = 0.5f;
+
+	/** How often a simulated proxy checks if it should be lightweight */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bUseLightweightProxies"))
+	float LightweightProxyCheckInterval = 0.25f;
+
+	/** Should this simulated proxy be lightweight right now? */
+	bool ShouldBeLightweightProxy() const;
+
+	/** Check, on a throttle, if this simulated proxy should be lightweight */
+	void UpdateLightweightProxy(float DeltaTime);
+
+	/** Lightweight proxies only take replicated movement mode and smooth towards the replicated transform */
+	void SimulatedTick(float DeltaSeconds) override;
+
+	/** If the server keeps a history of this character's capsule at the end of each move, for lag compensated hit registration */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Character Movement (Networking)")
+	bool bRecordLagCompensationHistory = true;
+
+	/** How many server frames of capsule history to keep. Should cover the highest ping we rewind for. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Character Movement (Networking)", meta = (ClampMin = "1", UIMin = "1", EditCondition = "bRecordLagCompensationHistory"))
+	int32 LagCompensationHistorySize = 64;
+
+	/** If the server checks this character's client moves against PB movement rules, see UPBMovementValidationSubsystem */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Character Movement (Networking)")
+	bool bValidateClientMoves = true;
+
+	/** Scale on the speeds validation allows, for timing differences between client and server */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Character Movement (Networking)", meta = (ClampMin = "1", UIMin = "1", EditCondition = "bValidateClientMoves"))
+	float ValidationSpeedTolerance = 1.1f;
+
+	/** Distance validation allows on top of any move, for quantisation and small corrections */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bValidateClientMoves"))
+	float ValidationPositionTolerance = 10.0f;
+
+	/** Violations, less decay, before we report a client as suspicious */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Character Movement (Networking)", meta = (ClampMin = "1", UIMin = "1", EditCondition = "bValidateClientMoves"))
+	float ValidationSuspicionThreshold = 5.0f;
+
+	/** Violations forgiven per second */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Character Movement (Networking)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bValidateClientMoves"))
+	float ValidationSuspicionDecayRate = 1.0f;
+
+	/** Hand a client's move to validation, see bValidateClientMoves */
+	void QueueValidationSample(float ClientTimeStamp, float DeltaTime, const FVector& ClientWorldLocation, UPrimitiveComponent* ClientMovementBase, uint8 ClientMovementMode);
+
+	/** Launches and impulses aren't PB movement, validation mustn't check the move they happen in */
+	bool HandlePendingLaunch() override;
+	void ApplyAccumulatedForces(float DeltaSeconds) override;
+
+	/** If AI controlled characters on the server should tick less often when no player can see them or they're far away */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)")
+	bool bUseAIMovementLOD = true;
+
+	/** Distance from the closest player beyond which an AI goes to reduced LOD, even if seen */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bUseAIMovementLOD"))
+	float AIMovementLODReducedDistance = 3000.0f;
+
+	/** Distance from the closest player beyond which an AI goes to minimal LOD */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bUseAIMovementLOD"))
+	float AIMovementLODMinimalDistance = 8000.0f;
+
+	/** Distance from the closest player within which an AI stays at full LOD, even if not seen */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bUseAIMovementLOD"))
+	float AIMovementLODNearDistance = 1000.0f;
+
+	/** Fraction of a distance an AI must come back inside before it leaves the LOD that distance put it in */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0", UIMin = "0", ClampMax = "0.5", UIMax = "0.5", EditCondition = "bUseAIMovementLOD"))
+	float AIMovementLODHysteresis = 0.1f;
+
+	/** Width of a player's view, in degrees, that counts as seeing an AI */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0", UIMin = "0", ClampMax = "360", UIMax = "360", EditCondition = "bUseAIMovementLOD"))
+	float AIMovementLODViewAngle = 120.0f;
+
+	/** Tick interval at reduced LOD */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bUseAIMovementLOD"))
+	float ReducedLODTickInterval = 1.0f / 30.0f;
+
+	/** Largest substep at reduced LOD */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0.0166", UIMin = "0.0166", EditCondition = "bUseAIMovementLOD"))
+	float ReducedLODMaxSimulationTimeStep = 1.0f / 33.0f;
+
+	/** Tick interval at minimal LOD */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bUseAIMovementLOD"))
+	float MinimalLODTickInterval = 1.0f / 10.0f;
+
+	/** Largest substep at minimal LOD */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0.0166", UIMin = "0.0166", EditCondition = "bUseAIMovementLOD"))
+	float MinimalLODMaxSimulationTimeStep = 1.0f / 15.0f;
+
+	/** How often an AI checks its movement LOD, going back to full LOD never waits longer than this, plus a reduced LOD tick when coming from minimal */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Movement (AI LOD)", meta = (ClampMin = "0", UIMin = "0", EditCondition = "bUseAIMovementLOD"))
+	float AIMovementLODCheckInterval = 0.2f;
+
+	/**
+	 * Source: CS2 sub-tick input. If the character has a timestamped input change this frame, run the part of the frame
+	 * before it as its own move with the input we had before, so the change takes effect when it happened rather than at the frame boundary.
+	 * Returns the time left for the rest of the frame.
+	 */
+	float PerformSubTickMove(float DeltaTime);
+
+	/** Movement LOD for an AI from how far it is from players and whether any can see it */
+	EPBMovementLOD CalculateAIMovementLOD() const;
+
+	/** Check, on a throttle, if this AI should change movement LOD */
+	void UpdateAIMovementLOD(float DeltaTime);
+
+	/** Apply the tick interval and substep of a movement LOD */
+	void SetMovementLOD(EPBMovementLOD NewLOD);
+
+	bool ServerExceedsAllowablePositionError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation,
+		UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
+	bool ServerShouldUseAuthoritativePosition(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation,
+		UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
+
+	/** Apply the PB intent the client sent with its move */
+	void UpdateFromCompressedFlags(uint8 Flags) override;
+
+	friend class FNetworkPredictionData_Client_PB;
+
 	/** Plays sound effect according to movement and surface */
 	virtual void PlayMoveSound(float DeltaTime);
 
@@ -251,10 +567,20 @@ public:
 
 	virtual void InitializeComponent() override;
 	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
+	virtual void OnTeleported() override;
+
+	FNetworkPredictionData_Client* GetPredictionData_Client() const override;
 
 	// Overrides for Source-like movement
 	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 	virtual void CalcVelocity(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration) override;
+	/** Source: CGameMovement::Accelerate and AirAccelerate. Add wish acceleration to a velocity, up to the speed cap along the wish direction. */
+	static FVector Accelerate(const FVector& InVelocity, const FVector& WishAccel, float SpeedCap, float AccelerationScale, float DeltaTime);
+	/** Source: ClipVelocity. Remove the part of the vector going into the plane, overbouncing by the given factor. */
+	static FVector ClipToPlane(const FVector& InVector, const FVector& Normal, float Overbounce);
+	/** Clip a move against all contact planes at once, following the crease between two planes if needed */
+	static FVector ClipToPlanes(const FVector& InVector, const FVector* Planes, int32 NumPlanes, const FVector& PrimalVector, float Overbounce);
 	virtual void ApplyVelocityBraking(float DeltaTime, float Friction, float BrakingDeceleration) override;
 	bool ShouldLimitAirControl(float DeltaTime, const FVector& FallAcceleration) const override;
 	FVector NewFallVelocity(const FVector& InitialVelocity, const FVector& Gravity, float DeltaTime) const override;
@@ -263,6 +589,8 @@ public:
 	void UpdateCharacterStateAfterMovement(float DeltaSeconds) override;
 
 	void UpdateSurfaceFriction(bool bIsSliding = false);
+	/** Advance the braking window after a move on the ground */
+	void UpdateBrakingWindow(float DeltaTime);
 	void UpdateCrouching(float DeltaTime, bool bOnlyUnCrouch = false);
 
 	// Overrides for crouch transitions
@@ -270,8 +598,12 @@ public:
 	virtual void UnCrouch(bool bClientSimulation = false) override;
 	virtual void DoCrouchResize(float TargetTime, float DeltaTime, bool bClientSimulation = false);
 	virtual void DoUnCrouchResize(float TargetTime, float DeltaTime, bool bClientSimulation = false);
+	/** Resize a simulated proxy's capsule to the end of a crouch transition, leaving the mesh to the replicated crouch progress */
+	void SetProxyCapsuleCrouched(bool bCrouched);
 
 	bool MoveUpdatedComponentImpl(const FVector& Delta, const FQuat& NewRotation, bool bSweep, FHitResult* OutHit = nullptr, ETeleportType Teleport = ETeleportType::None) override;
+	bool FloorSweepTest(FHitResult& OutHit, const FVector& Start, const FVector& End, ECollisionChannel TraceChannel, const FCollisionShape& CollisionShape,
+		const FCollisionQueryParams& Params, const FCollisionResponseParams& ResponseParam) const override;
 
 	// Jump overrides
 	bool CanAttemptJump() const override;
@@ -289,6 +621,8 @@ public:
 	float SlideAlongSurface(const FVector& Delta, float Time, const FVector& Normal, FHitResult& Hit, bool bHandleImpact = false) override;
 	FVector ComputeSlideVector(const FVector& Delta, const float Time, const FVector& Normal, const FHitResult& Hit) const override;
 	FVector HandleSlopeBoosting(const FVector& SlideResult, const FVector& Delta, const float Time, const FVector& Normal, const FHitResult& Hit) const override;
+	bool StepUp(const FVector& GravDir, const FVector& Delta, const FHitResult& Hit, FStepDownResult* OutStepDownResult = nullptr) override;
+	void FindFloor(const FVector& CapsuleLocation, FFindFloorResult& OutFloorResult, bool bCanUseCachedLocation, const FHitResult* DownwardSweepResult = nullptr) const override;
 	bool ShouldCatchAir(const FFindFloorResult& OldFloor, const FFindFloorResult& NewFloor) override;
 	bool IsWithinEdgeTolerance(const FVector& CapsuleLocation, const FVector& TestImpactPoint, const float CapsuleRadius) const override;
 	bool ShouldCheckForValidLandingSpot(float DeltaTime, const FVector& Delta, const FHitResult& Hit) const override;
@@ -313,8 +647,8 @@ public:
 
 	void OnMovementModeChanged(EMovementMode PreviousMovementMode, uint8 PreviousCustomMode) override;
 
-	/** Do camera roll effect based on velocity */
-	float GetCameraRoll();
+	/** Camera roll for our sideways velocity, applied by UPBCameraRollModifier */
+	float GetCameraRoll() const;
 
 	/** Is this player on a ladder? */
 	UFUNCTION(BlueprintCallable)
@@ -334,6 +668,102 @@ public:
 
 	bool IsCrouchSliding() const { return bCrouchSliding; }
 
+	/** Smooth crouch progress, 0 standing and 1 crouched */
+	float GetCrouchAlpha() const;
+
+	/** Crouch progress of the capsule size, which may lag behind the smooth crouch progress */
+	float GetCapsuleCrouchAlpha() const;
+
+	/** Eye height adjustment that makes up for the capsule being a step behind the smooth crouch */
+	float GetCrouchEyeHeightOffset() const;
+
+	/** Sweeps StepUp has made so far, by either step up version, for comparing their cost */
+	uint32 GetStepUpSweepCount() const { return StepUpSweepCount; }
+
+	/** Is this player resting, with floor checks and velocity integration skipped? */
+	bool IsResting() const { return bIsResting; }
+
+	/** Leave the resting state, so the next move does a full floor check */
+	void StopResting();
+
+	/**
+	 * Return every runtime movement field to its spawn default, so a pooled character can be reused without respawning.
+	 * Stands the capsule back up straight away, without a transition; teleport the character to its spawn after calling this.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Pawn|Components|CharacterMovement")
+	void ResetMovementState();
+
+	/** Capture all movement state of this character and its movement, for rollback */
+	void CaptureSnapshot(FPBMovementSnapshot& OutSnapshot) const;
+
+	/**
+	 * Put this character and its movement back exactly as captured, so re-simulating from here is deterministic.
+	 * Sets state directly, without movement mode change events or crouch transitions.
+	 */
+	void RestoreSnapshot(const FPBMovementSnapshot& Snapshot);
+
+	/** Called from OnJumped, so move validation allows for the jump's boost */
+	void NotifyJumped() { bValidationJumped = true; }
+
+	/** Are we replaying saved moves after a correction? Cosmetics are skipped while replaying. */
+	bool IsReplayingMoves() const { return CharacterOwner && CharacterOwner->bClientUpdating; }
+
+	bool ClientUpdatePositionAfterServerUpdate() override;
+
+	/** Note when moves actually go out, for input to server latency */
+	void CallServerMovePacked(const FSavedMove_Character* NewMove, const FSavedMove_Character* PendingMove, const FSavedMove_Character* OldMove) override;
+	void CallServerMove(const FSavedMove_Character* NewMove, const FSavedMove_Character* OldMove) override;
+
+	/** Acks and corrections both acknowledge our moves, measure input to ack latency before Super drops them */
+	void ClientAckGoodMove_Implementation(float TimeStamp) override;
+	void ClientAdjustPosition_Implementation(float TimeStamp, FVector NewLoc, FVector NewVel, UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase,
+		bool bBaseRelativePosition, uint8 ServerMovementMode, TOptional<FRotator> OptionalRotation = TOptional<FRotator>()) override;
+
+	// Simulated proxy extrapolation
+	void SimulateMovement(float DeltaTime) override;
+	void SmoothCorrection(const FVector& OldLocation, const FQuat& OldRotation, const FVector& NewLocation, const FQuat& NewRotation) override;
+
+	/** Set the acceleration a simulated proxy steers with, from the server */
+	void SetReplicatedAcceleration(const FVector& InAcceleration);
+
+	/** How much of the simulation this character runs, always full unless it's an AI on the server */
+	EPBMovementLOD GetMovementLOD() const { return MovementLOD; }
+
+	/** Milliseconds from an input event to the move that applies it changing velocity, last measured */
+	float GetInputToSimLatency() const { return InputToSimLatency; }
+
+	/** Milliseconds from an input event to the server applying it, estimated from the move's round trip */
+	float GetInputToServerLatency() const { return InputToServerLatency; }
+
+	/** Milliseconds from an input event to the server acknowledging the move that carried it */
+	float GetInputToAckLatency() const { return InputToAckLatency; }
+
+	/** Is this a simulated proxy that only interpolates its replicated transform? */
+	bool IsLightweightProxy() const { return bIsLightweightProxy; }
+
+	/** Running average of how far simulated proxy extrapolation was from the authoritative position, per update */
+	float GetProxyExtrapolationError() const { return ProxyExtrapolationError; }
+
+	/**
+	 * Our capsule as it was at a past server time, for hit registration.
+	 * @return false if we have no history, or it doesn't reach back to Time; OutSample is then the oldest we have
+	 */
+	bool GetLagCompensatedCapsule(double Time, FPBLagCompensationSample& OutSample) const;
+
+	/**
+	 * Rewind many capsules at once, e.g. for every shot fired this frame.
+	 * OutSamples must be as long as Queries. OutRewound is set per query as GetLagCompensatedCapsule would return.
+	 */
+	static void RewindCapsules(TConstArrayView<FPBLagCompensationQuery> Queries, TArrayView<FPBLagCompensationSample> OutSamples, TBitArray<>& OutRewound);
+
+	const FPBLagCompensationHistory& GetLagCompensationHistory() const { return LagCompensationHistory; }
+
+	/** Our current motion and air rules, to predict where we'll fly to with FPBTrajectoryPrediction */
+	void GetTrajectoryParams(FPBTrajectoryParams& OutParams, float Duration) const;
+
+	/** Where we'll be in Duration seconds if we keep our input and don't land, or where we land first */
+	void PredictTrajectory(float Duration, FPBTrajectoryResult& OutResult) const;
+
 	void SetShouldPlayMoveSounds(bool bShouldPlay) { bShouldPlayMoveSounds = bShouldPlay; }
 
 	virtual float GetMaxSpeed() const override;
@@ -346,6 +776,21 @@ private:
 	float DefaultSpeedMultMax;
 	float DefaultWalkableFloorZ;
 	float SurfaceFriction;
+
+	/** Our capsule at the end of recent server moves, see bRecordLagCompensationHistory */
+	FPBLagCompensationHistory LagCompensationHistory;
+
+	/** If we were launched or pushed since the last validation sample */
+	bool bValidationDiscontinuity = false;
+	/** If we started a jump since the last validation sample */
+	bool bValidationJumped = false;
+
+	/** Source: CGameMovement::StepMove, see bUseSourceStepUp */
+	bool SourceStepUp(const FVector& GravDir, const FVector& Delta, const FHitResult& InHit, FStepDownResult* OutStepDownResult);
+
+	/** If we're in StepUp, so its movement and floor sweeps count towards StepUpSweepCount */
+	bool bCountingStepUpSweeps = false;
+	mutable uint32 StepUpSweepCount = 0;
 	TWeakObjectPtr<UPrimitiveComponent> OldBase;
 
 	/** If we have done an initial landing */
@@ -359,4 +804,99 @@ private:
 
 	bool bHasDeferredMovementMode;
 	EMovementMode DeferredMovementMode;
+
+	/** if we've been idle long enough to skip floor checks */
+	bool bIsResting = false;
+
+	/** consecutive idle ticks counting towards RestingTickThreshold */
+	int32 IdleTicks = 0;
+
+	/** where we started resting, anything moving us wakes us up */
+	FVector RestingLocation = FVector::ZeroVector;
+
+	/** overlaps when we started resting, anything touching us wakes us up */
+	int32 RestingOverlapCount = 0;
+
+	/** the movement mode we last played cosmetics for, so a replay only plays its net result */
+	TEnumAsByte<EMovementMode> CosmeticMovementMode = MOVE_None;
+
+	/** if the client's position was off by a tolerated timing error, and we're taking it */
+	bool bAcceptClientPosition = false;
+
+	/** tolerated error we can still take the client's position for */
+	float ClientPositionAcceptBudget = 0.0f;
+
+	/** if the server has sent us acceleration to simulate with */
+	bool bHasReplicatedAcceleration = false;
+
+	/** running average of position error when a simulated proxy update arrives */
+	float ProxyExtrapolationError = 0.0f;
+
+	/** if we're a simulated proxy skipping simulation and cosmetics */
+	bool bIsLightweightProxy = false;
+
+	/** time until we next check if we should be a lightweight proxy */
+	float LightweightProxyCheckTime = 0.0f;
+
+	/** platform time of our last locally controlled tick, the start of the window sub-tick input is placed in */
+	double LastSubTickWindowTime = 0.0;
+
+	/** input state at the end of our last tick, for the part of a frame before an input change */
+	bool bSubTickPreviousPressedJump = false;
+	bool bSubTickPreviousWantsToCrouch = false;
+
+	/** platform time of the earliest input the move being simulated carries, 0 once measured */
+	double MoveInputTime = 0.0;
+
+	/** last measured input latencies, in milliseconds */
+	float InputToSimLatency = 0.0f;
+	float InputToServerLatency = 0.0f;
+	float InputToAckLatency = 0.0f;
+
+	/** Measure input to local sim latency for the move being simulated */
+	void RecordInputSimLatency();
+
+	/** Measure input to server and input to ack latency for an acknowledged move */
+	void RecordInputAckLatency(double InputTime, double SendTime);
+
+	/** Stamp the send time on moves going out for the first time */
+	static void MarkMovesSent(const FSavedMove_Character* NewMove, const FSavedMove_Character* PendingMove);
+
+	/** Measure latency for every move up to and including the one the server acknowledged, before the engine drops them */
+	void RecordAckedMovesLatency(float TimeStamp);
+
+	/** how much of the simulation we're running */
+	EPBMovementLOD MovementLOD = EPBMovementLOD::Full;
+
+	/** time until we next check our movement LOD */
+	float AIMovementLODCheckTime = 0.0f;
+
+	/** substep at full LOD */
+	float DefaultMaxSimulationTimeStep;
+
+	/** tick interval at full LOD, as configured */
+	float DefaultTickInterval = 0.0f;
+
+	/** if we have a floor from the last full floor find to reuse */
+	mutable bool bHasCachedFloor = false;
+
+	/** where and how tall we were when we found the cached floor */
+	mutable FVector CachedFloorLocation = FVector::ZeroVector;
+	mutable float CachedFloorHalfHeight = 0.0f;
+
+	/** the last full floor find, reused if we ask again without moving */
+	mutable FFindFloorResult CachedFloor;
+
+	/** Source: CGameMovement::StayOnGround. Returns false if the full floor find is needed. */
+	bool SnapToGround(const FVector& CapsuleLocation, FFindFloorResult& OutFloorResult) const;
+
+	/** Should we run move and jump sounds and the other cosmetics? Never on a dedicated server. */
+	FORCEINLINE bool ShouldRunCosmetics() const
+	{
+#if PB_WITH_COSMETICS
+		return !IsNetMode(NM_DedicatedServer);
+#else
+		return false;
+#endif
+	}
 };
@@ -0,0 +1,64 @@
+// Copyright Project Borealis
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+
+class AActor;
+class UWorld;
+
+/** Where a trajectory starts and the PB air rules it flies by, see UPBPlayerMovement::GetTrajectoryParams */
+struct FPBTrajectoryParams
+{
+	FVector Location = FVector::ZeroVector;
+	FVector Velocity = FVector::ZeroVector;
+	/** Input acceleration, held for the whole prediction. Zero for a pure ballistic arc. */
+	FVector WishAccel = FVector::ZeroVector;
+	float GravityZ = 0.0f;
+	float AirSpeedCap = 0.0f;
+	float AirAccelerationMultiplier = 0.0f;
+	float AxisSpeedLimit = 0.0f;
+	/** Fall speed limit of the physics volume we start in */
+	float TerminalVelocity = 0.0f;
+	float WalkableFloorZ = 0.0f;
+
+	/** How far ahead to predict, in seconds */
+	float Duration = 1.0f;
+	/** Air steering step, ballistic arcs are integrated exactly between sweeps */
+	float TimeStep = 1.0f / 66.0f;
+	/** Time between collision sweeps, longer is cheaper but can cut corners */
+	float SweepInterval = 0.1f;
+
+	float CapsuleRadius = 0.0f;
+	float CapsuleHalfHeight = 0.0f;
+	ECollisionChannel CollisionChannel = ECC_Pawn;
+	/** Usually the predicted character, so it doesn't hit itself */
+	const AActor* IgnoredActor = nullptr;
+};
+
+/** Where a trajectory ended: after its duration, or where it first hit something */
+struct FPBTrajectoryResult
+{
+	FVector Location = FVector::ZeroVector;
+	FVector Velocity = FVector::ZeroVector;
+	float Time = 0.0f;
+	bool bHit = false;
+	/** If what we hit is walkable floor */
+	bool bLanded = false;
+	FVector HitNormal = FVector::ZeroVector;
+};
+
+/**
+ * Fast forward simulation of PB falling and air strafing, for AI, UI and anti-cheat asking "where will they be?".
+ * Gravity follows NewFallVelocity, including the AxisSpeedLimit clamp, and is integrated exactly. Air steering uses
+ * UPBPlayerMovement::Accelerate. Collision is only swept every SweepInterval, so this is much cheaper than running movement.
+ */
+struct PBCHARACTERMOVEMENT_API FPBTrajectoryPrediction
+{
+	/** Predict one trajectory. World may be null to skip collision. OutPath, if given, gets the location at each sweep. */
+	static void Predict(const UWorld* World, const FPBTrajectoryParams& Params, FPBTrajectoryResult& OutResult, TArray<FVector>* OutPath = nullptr);
+
+	/** Predict many trajectories in parallel. OutResults must be as long as Params. */
+	static void PredictBatch(const UWorld* World, TConstArrayView<FPBTrajectoryParams> Params, TArrayView<FPBTrajectoryResult> OutResults);
+};